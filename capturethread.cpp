@@ -0,0 +1,258 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "util.h"
+#include "capturethread.h"
+#include "framesource.h"
+#include "spscring.h"
+#include "framesynchronizer.h"
+#include "colormapper.h"
+#include "sessionrecorder.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDebug>
+
+static const quint32 RingCapacity = 4;
+static const int WaitTimeoutMs = 100;
+
+
+class CaptureThreadPrivate {
+public:
+  CaptureThreadPrivate(FrameSource *frameSource)
+    : frameSource(frameSource)
+    , colorMapper(frameSource)
+    , ring(RingCapacity)
+    , notificationPending(0)
+    , droppedFrameSets(0)
+    , recorder(nullptr)
+    , recorderCalibrated(false)
+    , recordMapping(0)
+    , colorMapping(true)
+    , calibrationAnnounced(false)
+  { /* ... */ }
+  ~CaptureThreadPrivate()
+  {
+    SafeDelete(recorder);
+  }
+
+  FrameSource *frameSource;
+  FrameSynchronizer synchronizer;
+  ColorMapper colorMapper;
+  SpscRing<FrameSet> ring;
+  QAtomicInt notificationPending;
+  QAtomicInt droppedFrameSets;
+  mutable QMutex recorderMutex;
+  SessionRecorder *recorder;
+  bool recorderCalibrated;
+  // while set, the source's mapping is used so that it can be recorded
+  QAtomicInt recordMapping;
+  bool colorMapping;
+  bool calibrationAnnounced;
+};
+
+
+CaptureThread::CaptureThread(FrameSource *frameSource, QObject *parent)
+  : QThread(parent)
+  , d_ptr(new CaptureThreadPrivate(frameSource))
+{
+  // ...
+}
+
+
+CaptureThread::~CaptureThread()
+{
+  stop();
+  stopRecording();
+}
+
+
+void CaptureThread::stop(void)
+{
+  requestInterruption();
+  wait();
+}
+
+
+void CaptureThread::run(void)
+{
+  Q_D(CaptureThread);
+  QElapsedTimer waited;
+  while (!isInterruptionRequested()) {
+    waited.start();
+    if (!d->frameSource->waitForFrames(WaitTimeoutMs)) {
+      // a source that can't deliver at all, e.g. one that isn't open,
+      // fails right away and mustn't make this thread spin
+      if (waited.elapsed() < WaitTimeoutMs / 2)
+        QThread::msleep(WaitTimeoutMs);
+      continue;
+    }
+    if (d->frameSource->acquireDepthFrame(d->synchronizer.depthSlot()))
+      d->synchronizer.commitDepth();
+    if (d->frameSource->acquireIRFrame(d->synchronizer.irSlot()))
+      d->synchronizer.commitIR();
+    if (d->frameSource->acquireColorFrame(d->synchronizer.colorSlot()))
+      d->synchronizer.commitColor();
+    while (d->synchronizer.match()) {
+      FrameSet frameSet = d->synchronizer.takeFrameSet();
+      const bool recordMapping = d->recordMapping.load() != 0;
+      if (d->colorMapping || recordMapping)
+        frameSet.mapping = d->colorMapper.map(frameSet.depth, recordMapping ? ColorMapper::SourceMethod : ColorMapper::NativeMethod);
+      SensorCalibration calibration;
+      if (!d->calibrationAnnounced && d->colorMapper.calibration(calibration)) {
+        d->calibrationAnnounced = true;
+        emit calibrationAvailable(calibration);
+      }
+      {
+        QMutexLocker lock(&d->recorderMutex);
+        if (d->recorder != nullptr) {
+          if (!d->recorderCalibrated && d->colorMapper.calibration(calibration)) {
+            d->recorder->setCalibration(calibration);
+            d->recorderCalibrated = true;
+          }
+          d->recorder->enqueue(frameSet);
+        }
+      }
+      FrameSet *slot = d->ring.beginWrite();
+      // a source that isn't real-time mustn't lose frames, so wait for the consumer
+      while (slot == nullptr && !d->frameSource->isRealTime() && !isInterruptionRequested()) {
+        QThread::usleep(500);
+        slot = d->ring.beginWrite();
+      }
+      if (slot == nullptr) {
+        d->droppedFrameSets.ref();
+        continue;
+      }
+      *slot = frameSet;
+      d->ring.endWrite();
+      if (d->notificationPending.testAndSetOrdered(0, 1))
+        emit framesAvailable();
+    }
+  }
+}
+
+
+FrameSet CaptureThread::takeLatestFrameSet(void)
+{
+  Q_D(CaptureThread);
+  // reset before draining so that a set published meanwhile triggers a new notification
+  d->notificationPending.storeRelease(0);
+  if (d->frameSource->isRealTime()) {
+    while (d->ring.count() > 1) {
+      d->ring.front()->reset();
+      d->ring.pop();
+      d->droppedFrameSets.ref();
+    }
+  }
+  FrameSet frameSet;
+  FrameSet *slot = d->ring.front();
+  if (slot != nullptr) {
+    // leave nothing behind in the slot that would keep the frames from their pools
+    frameSet = std::move(*slot);
+    d->ring.pop();
+  }
+  // sets that were already waiting don't raise another notification by themselves
+  if (!d->ring.isEmpty() && d->notificationPending.testAndSetOrdered(0, 1))
+    QMetaObject::invokeMethod(this, "framesAvailable", Qt::QueuedConnection);
+  return frameSet;
+}
+
+
+int CaptureThread::droppedFrameSets(void) const
+{
+  Q_D(const CaptureThread);
+  return d->droppedFrameSets.load();
+}
+
+
+int CaptureThread::discardedFrameSets(void) const
+{
+  Q_D(const CaptureThread);
+  return d->synchronizer.discardedFrameSets();
+}
+
+
+void CaptureThread::setSkewTolerance(INT64 skewTolerance)
+{
+  Q_D(CaptureThread);
+  Q_ASSERT_X(!isRunning(), "CaptureThread::setSkewTolerance()", "must be called before start()");
+  d->synchronizer.setSkewTolerance(skewTolerance);
+}
+
+
+void CaptureThread::setColorMapping(bool enabled)
+{
+  Q_D(CaptureThread);
+  Q_ASSERT_X(!isRunning(), "CaptureThread::setColorMapping()", "must be called before start()");
+  d->colorMapping = enabled;
+}
+
+
+void CaptureThread::setRemapTolerance(int tolerance)
+{
+  Q_D(CaptureThread);
+  Q_ASSERT_X(!isRunning(), "CaptureThread::setRemapTolerance()", "must be called before start()");
+  d->colorMapper.setRemapTolerance(tolerance);
+}
+
+
+bool CaptureThread::startRecording(const QString &fileName, bool recordMapping)
+{
+  Q_D(CaptureThread);
+  SessionRecorder *recorder = new SessionRecorder(fileName, recordMapping);
+  if (!recorder->open()) {
+    delete recorder;
+    return false;
+  }
+  stopRecording();
+  recorder->start();
+  QMutexLocker lock(&d->recorderMutex);
+  d->recorder = recorder;
+  d->recorderCalibrated = false;
+  d->recordMapping.store(recordMapping ? 1 : 0);
+  qDebug() << "Recording to" << fileName;
+  return true;
+}
+
+
+void CaptureThread::stopRecording(void)
+{
+  Q_D(CaptureThread);
+  SessionRecorder *recorder = nullptr;
+  {
+    QMutexLocker lock(&d->recorderMutex);
+    recorder = d->recorder;
+    d->recorder = nullptr;
+    d->recordMapping.store(0);
+  }
+  if (recorder == nullptr)
+    return;
+  recorder->stop();
+  delete recorder;
+}
+
+
+bool CaptureThread::isRecording(void) const
+{
+  Q_D(const CaptureThread);
+  QMutexLocker lock(&d->recorderMutex);
+  return d->recorder != nullptr;
+}
@@ -0,0 +1,84 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __CAPTURETHREAD_H_
+#define __CAPTURETHREAD_H_
+
+#include <QThread>
+#include <QScopedPointer>
+#include <QString>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+class FrameSource;
+class CaptureThreadPrivate;
+
+// Waits for frames from a FrameSource, matches them by timestamp, maps
+// the color into the depth frame and pushes the frame sets into a
+// bounded single-producer/single-consumer ring. The consumer (i.e. the
+// render thread) drains the ring after framesAvailable() was emitted.
+class CaptureThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  explicit CaptureThread(FrameSource *frameSource, QObject *parent = nullptr);
+  ~CaptureThread();
+
+  void stop(void);
+
+  // consumer side: returns the most recent frame set, discarding older
+  // ones, or a null set if nothing new has arrived
+  FrameSet takeLatestFrameSet(void);
+
+  // sets the ring had no room for
+  int droppedFrameSets(void) const;
+  // depth frames the synchronizer found no color or IR partner for
+  int discardedFrameSets(void) const;
+  // maximum difference of the RelativeTime stamps within a set, in 100 ns ticks
+  void setSkewTolerance(INT64);
+  // if disabled, the frame sets carry no mapping and the consumer
+  // registers the frames itself from the calibration
+  void setColorMapping(bool enabled);
+  // depth changes in millimeters below which the mapping isn't redone
+  void setRemapTolerance(int);
+
+  // frame sets are handed to a SessionRecorder by reference; with
+  // recordMapping the source's own mapping is recorded, so that the
+  // native mapper can be checked against it (see verifyMapping())
+  bool startRecording(const QString &fileName, bool recordMapping = false);
+  void stopRecording(void);
+  bool isRecording(void) const;
+
+signals:
+  void framesAvailable(void);
+  // emitted once as soon as the frame source knows it
+  void calibrationAvailable(const SensorCalibration&);
+
+protected:
+  virtual void run(void);
+
+private:
+  QScopedPointer<CaptureThreadPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(CaptureThread)
+  Q_DISABLE_COPY(CaptureThread)
+};
+
+#endif // __CAPTURETHREAD_H_
@@ -0,0 +1,156 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "util.h"
+#include "simd.h"
+#include "colorconversion.h"
+
+
+static inline QRgb yuvToBgra(int y, int u, int v)
+{
+  const int c = 298 * (y - 16) + 128;
+  const int d = u - 128;
+  const int e = v - 128;
+  const int r = clamp((c + 409 * e) >> 8, 0, 255);
+  const int g = clamp((c - 100 * d - 208 * e) >> 8, 0, 255);
+  const int b = clamp((c + 516 * d) >> 8, 0, 255);
+  return qRgb(r, g, b);
+}
+
+
+static void yuy2ToBgraScalar(const uchar *src, QRgb *dst, int pixelCount)
+{
+  const uchar *const srcEnd = src + 2 * pixelCount;
+  while (src < srcEnd) {
+    dst[0] = yuvToBgra(src[0], src[1], src[3]);
+    dst[1] = yuvToBgra(src[2], src[1], src[3]);
+    src += 4;
+    dst += 2;
+  }
+}
+
+
+#ifdef W1_X86
+
+// The vector kernels evaluate the same integer formula as yuvToBgra()
+// in 32 bit lanes, so their results are identical. Both work lane by
+// lane on 8 pixels per 128 bits:
+//
+//   luma:   madd((Y - 16, 1), (298, 128)) = 298 * (Y - 16) + 128
+//   chroma: madd((U - 128, V - 128), coefficients) per macropixel,
+//           duplicated for both of its pixels
+//
+// packs/packus then saturate to 0..255 like clamp() does.
+
+static void yuy2ToBgraSse2(const uchar *src, QRgb *dst, int pixelCount)
+{
+  const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+  const __m128i lumaOffset = _mm_set1_epi16(16);
+  const __m128i chromaOffset = _mm_set1_epi16(128);
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i lumaCoeffs = _mm_set_epi16(128, 298, 128, 298, 128, 298, 128, 298);
+  const __m128i rCoeffs = _mm_set_epi16(409, 0, 409, 0, 409, 0, 409, 0);
+  const __m128i gCoeffs = _mm_set_epi16(-208, -100, -208, -100, -208, -100, -208, -100);
+  const __m128i bCoeffs = _mm_set_epi16(0, 516, 0, 516, 0, 516, 0, 516);
+  const __m128i alpha = _mm_set1_epi8(char(0xff));
+  const int vectorCount = pixelCount & ~7;
+  for (int i = 0; i < vectorCount; i += 8) {
+    const __m128i yuy2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+    const __m128i y = _mm_sub_epi16(_mm_and_si128(yuy2, lumaMask), lumaOffset);
+    const __m128i uv = _mm_sub_epi16(_mm_srli_epi16(yuy2, 8), chromaOffset);
+    const __m128i cLo = _mm_madd_epi16(_mm_unpacklo_epi16(y, one), lumaCoeffs);
+    const __m128i cHi = _mm_madd_epi16(_mm_unpackhi_epi16(y, one), lumaCoeffs);
+    const __m128i rc = _mm_madd_epi16(uv, rCoeffs);
+    const __m128i gc = _mm_madd_epi16(uv, gCoeffs);
+    const __m128i bc = _mm_madd_epi16(uv, bCoeffs);
+    const __m128i r = _mm_packs_epi32(
+          _mm_srai_epi32(_mm_add_epi32(cLo, _mm_unpacklo_epi32(rc, rc)), 8),
+          _mm_srai_epi32(_mm_add_epi32(cHi, _mm_unpackhi_epi32(rc, rc)), 8));
+    const __m128i g = _mm_packs_epi32(
+          _mm_srai_epi32(_mm_add_epi32(cLo, _mm_unpacklo_epi32(gc, gc)), 8),
+          _mm_srai_epi32(_mm_add_epi32(cHi, _mm_unpackhi_epi32(gc, gc)), 8));
+    const __m128i b = _mm_packs_epi32(
+          _mm_srai_epi32(_mm_add_epi32(cLo, _mm_unpacklo_epi32(bc, bc)), 8),
+          _mm_srai_epi32(_mm_add_epi32(cHi, _mm_unpackhi_epi32(bc, bc)), 8));
+    const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+  }
+  yuy2ToBgraScalar(src + 2 * vectorCount, dst + vectorCount, pixelCount - vectorCount);
+}
+
+
+W1_TARGET_AVX2
+static void yuy2ToBgraAvx2(const uchar *src, QRgb *dst, int pixelCount)
+{
+  const __m256i lumaMask = _mm256_set1_epi16(0x00ff);
+  const __m256i lumaOffset = _mm256_set1_epi16(16);
+  const __m256i chromaOffset = _mm256_set1_epi16(128);
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i lumaCoeffs = _mm256_set1_epi32(298 | (128 << 16));
+  const __m256i rCoeffs = _mm256_set1_epi32(409 << 16);
+  // -100 in the low and -208 in the high word
+  const __m256i gCoeffs = _mm256_set1_epi32(int(0xff30ff9c));
+  const __m256i bCoeffs = _mm256_set1_epi32(516);
+  const __m256i alpha = _mm256_set1_epi8(char(0xff));
+  const int vectorCount = pixelCount & ~15;
+  for (int i = 0; i < vectorCount; i += 16) {
+    const __m256i yuy2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+    const __m256i y = _mm256_sub_epi16(_mm256_and_si256(yuy2, lumaMask), lumaOffset);
+    const __m256i uv = _mm256_sub_epi16(_mm256_srli_epi16(yuy2, 8), chromaOffset);
+    const __m256i cLo = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, one), lumaCoeffs);
+    const __m256i cHi = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, one), lumaCoeffs);
+    const __m256i rc = _mm256_madd_epi16(uv, rCoeffs);
+    const __m256i gc = _mm256_madd_epi16(uv, gCoeffs);
+    const __m256i bc = _mm256_madd_epi16(uv, bCoeffs);
+    const __m256i r = _mm256_packs_epi32(
+          _mm256_srai_epi32(_mm256_add_epi32(cLo, _mm256_unpacklo_epi32(rc, rc)), 8),
+          _mm256_srai_epi32(_mm256_add_epi32(cHi, _mm256_unpackhi_epi32(rc, rc)), 8));
+    const __m256i g = _mm256_packs_epi32(
+          _mm256_srai_epi32(_mm256_add_epi32(cLo, _mm256_unpacklo_epi32(gc, gc)), 8),
+          _mm256_srai_epi32(_mm256_add_epi32(cHi, _mm256_unpackhi_epi32(gc, gc)), 8));
+    const __m256i b = _mm256_packs_epi32(
+          _mm256_srai_epi32(_mm256_add_epi32(cLo, _mm256_unpacklo_epi32(bc, bc)), 8),
+          _mm256_srai_epi32(_mm256_add_epi32(cHi, _mm256_unpackhi_epi32(bc, bc)), 8));
+    const __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+    const __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), alpha);
+    // every 128 bit lane holds pixels 0..3 in lo and 4..7 in hi
+    const __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+    const __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  yuy2ToBgraSse2(src + 2 * vectorCount, dst + vectorCount, pixelCount - vectorCount);
+}
+
+#endif // W1_X86
+
+
+void yuy2ToBgra(const uchar *src, QRgb *dst, int pixelCount)
+{
+#ifdef W1_X86
+  if (cpuSupportsAvx2())
+    yuy2ToBgraAvx2(src, dst, pixelCount);
+  else
+    yuy2ToBgraSse2(src, dst, pixelCount);
+#else
+  yuy2ToBgraScalar(src, dst, pixelCount);
+#endif
+}
@@ -0,0 +1,30 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __COLORCONVERSION_H_
+#define __COLORCONVERSION_H_
+
+#include <QRgb>
+
+// Converts packed YUY2 (Y0 U Y1 V) to BGRA with the integer BT.601
+// studio swing formula the Kinect SDK uses. pixelCount must be even.
+// Uses AVX2 or SSE2 if available; safe to call from any thread.
+void yuy2ToBgra(const uchar *src, QRgb *dst, int pixelCount);
+
+#endif // __COLORCONVERSION_H_
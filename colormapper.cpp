@@ -0,0 +1,132 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "colormapper.h"
+#include "coordinatemapper.h"
+#include "framesource.h"
+#include "mappingconversion.h"
+#include "util.h"
+
+#include <cstring>
+
+#include <QDebug>
+
+
+class ColorMapperPrivate {
+public:
+  ColorMapperPrivate(FrameSource *frameSource)
+    : frameSource(frameSource)
+    , depthSpacePoints(nullptr)
+    , nativeMapper(nullptr)
+    , remapTolerance(-1)
+    , sequence(0)
+  { /* ... */ }
+  ~ColorMapperPrivate()
+  {
+    SafeDeleteArray(depthSpacePoints);
+    SafeDelete(nativeMapper);
+  }
+
+  FrameSource *frameSource;
+  SensorCalibration calibration;
+  CoordinateMapper *nativeMapper;
+  // -1 leaves the CoordinateMapper's default
+  int remapTolerance;
+  // the native mapper's last result, which the next one starts from
+  MappingFrameRef previous;
+  quint64 sequence;
+  // for sources that can only deliver depth space points, allocated on first use
+  DepthSpacePoint *depthSpacePoints;
+};
+
+
+ColorMapper::ColorMapper(FrameSource *frameSource)
+  : d_ptr(new ColorMapperPrivate(frameSource))
+{
+  // ...
+}
+
+
+ColorMapper::~ColorMapper()
+{
+  // ...
+}
+
+
+MappingFrameRef ColorMapper::map(const DepthFrameRef &depthFrame, Method method)
+{
+  Q_D(ColorMapper);
+  SensorCalibration calibration;
+  const bool native = method == NativeMethod && this->calibration(calibration);
+  MappingFrameRef mappingFrame = mappingFramePool().acquire();
+  MappingFrameData &mapping = mappingFrame.writable();
+  mapping.timestamp = depthFrame->timestamp;
+  mapping.width = ColorWidth;
+  mapping.height = ColorHeight;
+  mapping.sequence = ++d->sequence;
+  mapping.dirtyRects.clear();
+  if (native) {
+    if (d->previous.isNull()) {
+      d->nativeMapper->mapColorFrameToDepthSpace(depthFrame->buffer, mapping.buffer);
+      mapping.dirtyRects.append(QRect(0, 0, ColorWidth, ColorHeight));
+    }
+    else {
+      memcpy(mapping.buffer, d->previous->buffer, ColorSize * sizeof(DSP));
+      mapping.dirtyRects = d->nativeMapper->updateColorFrameMapping(depthFrame->buffer, mapping.buffer);
+    }
+    d->previous = mappingFrame;
+    return mappingFrame;
+  }
+  d->previous = MappingFrameRef();
+  mapping.dirtyRects.append(QRect(0, 0, ColorWidth, ColorHeight));
+  if (d->frameSource->mapColorFrameToDsp(depthFrame->buffer, mapping.buffer))
+    return mappingFrame;
+  if (d->depthSpacePoints == nullptr)
+    d->depthSpacePoints = new DepthSpacePoint[ColorSize];
+  if (!d->frameSource->mapColorFrameToDepthSpace(depthFrame->buffer, d->depthSpacePoints))
+    return MappingFrameRef();
+  depthSpacePointsToDsp(d->depthSpacePoints, mapping.buffer, ColorSize);
+  return mappingFrame;
+}
+
+
+bool ColorMapper::calibration(SensorCalibration &calibration)
+{
+  Q_D(ColorMapper);
+  // the sensor may need some frames before it knows its calibration
+  if (d->nativeMapper == nullptr && d->frameSource->calibration(d->calibration)) {
+    qDebug() << "Sensor calibration available.";
+    d->nativeMapper = new CoordinateMapper(d->calibration);
+    if (d->remapTolerance >= 0)
+      d->nativeMapper->setTolerance(d->remapTolerance);
+  }
+  if (d->nativeMapper == nullptr)
+    return false;
+  calibration = d->calibration;
+  return true;
+}
+
+
+void ColorMapper::setRemapTolerance(int tolerance)
+{
+  Q_D(ColorMapper);
+  d->remapTolerance = tolerance;
+  if (d->nativeMapper != nullptr)
+    d->nativeMapper->setTolerance(tolerance);
+}
@@ -0,0 +1,63 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __COLORMAPPER_H_
+#define __COLORMAPPER_H_
+
+#include <QScopedPointer>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+class FrameSource;
+class ColorMapperPrivate;
+
+// Maps the color frame into the depth frame once per depth frame and
+// stores the result as compact DSPs to be shared by all consumers.
+// As soon as the frame source provides a calibration the mapping is
+// computed natively by a CoordinateMapper, otherwise the source is
+// asked for it. The native mapping is only recomputed where the depth
+// frame changed by more than the remap tolerance, see
+// MappingFrameData::dirtyRects.
+class ColorMapper
+{
+public:
+  enum Method {
+    NativeMethod,
+    SourceMethod
+  };
+
+  explicit ColorMapper(FrameSource *frameSource);
+  ~ColorMapper();
+
+  MappingFrameRef map(const DepthFrameRef&, Method = NativeMethod);
+
+  // asks the frame source until it provides one
+  bool calibration(SensorCalibration&);
+
+  // in millimeters; 0 remaps every frame completely
+  void setRemapTolerance(int);
+
+private:
+  QScopedPointer<ColorMapperPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(ColorMapper)
+  Q_DISABLE_COPY(ColorMapper)
+};
+
+#endif // __COLORMAPPER_H_
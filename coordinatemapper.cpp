@@ -0,0 +1,418 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "util.h"
+#include "simd.h"
+#include "coordinatemapper.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+
+// the depth frame is watched for changes in tiles of this size
+static const int DepthTileSize = 32;
+static const int DepthTilesX = (DepthWidth + DepthTileSize - 1) / DepthTileSize;
+static const int DepthTilesY = (DepthHeight + DepthTileSize - 1) / DepthTileSize;
+// a tile only counts as changed if more pixels than this changed,
+// which keeps flickering edge pixels from dirtying it every frame
+static const int DepthTileNoisePixels = 8;
+// and remapped in tiles of this size
+static const int ColorTileSize = 60;
+static const int ColorTilesX = ColorWidth / ColorTileSize;
+static const int ColorTilesY = ColorHeight / ColorTileSize;
+static const int DefaultTolerance = 20;
+
+
+struct Band {
+  int begin;
+  int end;
+};
+
+
+static QVector<Band> makeBands(int rows, int count)
+{
+  QVector<Band> bands;
+  for (int i = 0; i < count; ++i) {
+    Band band;
+    band.begin = rows * i / count;
+    band.end = rows * (i + 1) / count;
+    bands.append(band);
+  }
+  return bands;
+}
+
+
+static QVector<QRect> makeColorBands(int count)
+{
+  QVector<QRect> bands;
+  foreach (const Band &band, makeBands(ColorHeight, count))
+    bands.append(QRect(0, band.begin, ColorWidth, band.end - band.begin));
+  return bands;
+}
+
+
+// Depth pixel i with depth z lands on the color pixel
+//   u = (z * coeffU[i] + offsetU) / (z * coeffW[i] + offsetW)
+//   v = (z * coeffV[i] + offsetV) / (z * coeffW[i] + offsetW)
+// which is the color projection applied to the undistorted depth pixel.
+struct Projection {
+  const float *coeffU;
+  const float *coeffV;
+  const float *coeffW;
+  float offsetU;
+  float offsetV;
+  float offsetW;
+};
+
+
+static void projectScalar(const Projection &p, const UINT16 *depth, float *u, float *v, int begin, int end)
+{
+  for (int i = begin; i < end; ++i) {
+    const float z = float(depth[i]);
+    const float w = z * p.coeffW[i] + p.offsetW;
+    u[i] = (z * p.coeffU[i] + p.offsetU) / w;
+    v[i] = (z * p.coeffV[i] + p.offsetV) / w;
+  }
+}
+
+
+#ifdef W1_X86
+
+W1_TARGET_AVX2
+static void projectAvx2(const Projection &p, const UINT16 *depth, float *u, float *v, int begin, int end)
+{
+  const __m256 offsetU = _mm256_set1_ps(p.offsetU);
+  const __m256 offsetV = _mm256_set1_ps(p.offsetV);
+  const __m256 offsetW = _mm256_set1_ps(p.offsetW);
+  const int vectorEnd = begin + ((end - begin) & ~7);
+  for (int i = begin; i < vectorEnd; i += 8) {
+    const __m256 z = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i))));
+    const __m256 w = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(p.coeffW + i)), offsetW);
+    const __m256 nu = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(p.coeffU + i)), offsetU);
+    const __m256 nv = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(p.coeffV + i)), offsetV);
+    _mm256_storeu_ps(u + i, _mm256_div_ps(nu, w));
+    _mm256_storeu_ps(v + i, _mm256_div_ps(nv, w));
+  }
+  projectScalar(p, depth, u, v, vectorEnd, end);
+}
+
+#endif // W1_X86
+
+
+class CoordinateMapperPrivate {
+public:
+  CoordinateMapperPrivate(const SensorCalibration &calibration);
+  ~CoordinateMapperPrivate()
+  {
+    SafeDeleteArray(coeffU);
+    SafeDeleteArray(coeffV);
+    SafeDeleteArray(coeffW);
+    SafeDeleteArray(footprintU);
+    SafeDeleteArray(footprintV);
+    SafeDeleteArray(colorU);
+    SafeDeleteArray(colorV);
+    SafeDeleteArray(zBuffer);
+    SafeDeleteArray(referenceDepth);
+  }
+
+  void markColorTiles(float u, float v, int i, bool *dirty) const;
+
+  void project(const Band &depthRows);
+  void splat(const QRect &colorRect);
+  QVector<QRect> changedColorRects(void);
+
+  float *coeffU;
+  float *coeffV;
+  float *coeffW;
+  Projection projection;
+  // half the extent of each depth pixel in the color frame
+  float *footprintU;
+  float *footprintV;
+  float maxFootprintV;
+
+  // the current frame
+  const UINT16 *depth;
+  DSP *dsp;
+  // where the depth pixels landed, and the range each depth row covers
+  float *colorU;
+  float *colorV;
+  float rowMinV[DepthHeight];
+  float rowMaxV[DepthHeight];
+  UINT16 *zBuffer;
+
+  // the depth frame the current mapping was made from
+  UINT16 *referenceDepth;
+  bool hasReference;
+  int tolerance;
+
+  QVector<Band> depthBands;
+  QVector<QRect> colorBands;
+};
+
+
+CoordinateMapperPrivate::CoordinateMapperPrivate(const SensorCalibration &calibration)
+  : coeffU(new float[DepthSize])
+  , coeffV(new float[DepthSize])
+  , coeffW(new float[DepthSize])
+  , footprintU(new float[DepthSize])
+  , footprintV(new float[DepthSize])
+  , maxFootprintV(0.f)
+  , depth(nullptr)
+  , dsp(nullptr)
+  , colorU(new float[DepthSize])
+  , colorV(new float[DepthSize])
+  , zBuffer(new UINT16[ColorSize])
+  , referenceDepth(new UINT16[DepthSize])
+  , hasReference(false)
+  , tolerance(DefaultTolerance)
+{
+  const double (*P)[4] = calibration.colorProjection;
+  calibration.colorProjectionTable(coeffU, coeffV, coeffW);
+  // The footprint spans half way to the neighbors, as seen from a
+  // distance where the translation between the cameras is negligible.
+  // The lens distortion makes it grow towards the edges. The slight
+  // excess keeps rounding from leaving cracks between neighbors.
+  static const float Excess = 1.01f;
+  for (int v = 0; v < DepthHeight; ++v) {
+    for (int u = 0; u < DepthWidth; ++u) {
+      const int i = u + v * DepthWidth;
+      const int left = qMax(u - 1, 0) + v * DepthWidth;
+      const int right = qMin(u + 1, DepthWidth - 1) + v * DepthWidth;
+      const int up = u + qMax(v - 1, 0) * DepthWidth;
+      const int down = u + qMin(v + 1, DepthHeight - 1) * DepthWidth;
+      footprintU[i] = Excess * std::fabs(coeffU[right] / coeffW[right] - coeffU[left] / coeffW[left]) / (2 * (right - left));
+      footprintV[i] = Excess * std::fabs(coeffV[down] / coeffW[down] - coeffV[up] / coeffW[up]) / (2 * (down - up) / DepthWidth);
+      maxFootprintV = qMax(maxFootprintV, footprintV[i]);
+    }
+  }
+  projection.coeffU = coeffU;
+  projection.coeffV = coeffV;
+  projection.coeffW = coeffW;
+  projection.offsetU = float(P[0][3]);
+  projection.offsetV = float(P[1][3]);
+  projection.offsetW = float(P[2][3]);
+  const int threads = qMax(1, QThread::idealThreadCount());
+  depthBands = makeBands(DepthHeight, threads);
+  colorBands = makeColorBands(2 * threads);
+}
+
+
+void CoordinateMapperPrivate::project(const Band &depthRows)
+{
+  const int begin = depthRows.begin * DepthWidth;
+  const int end = depthRows.end * DepthWidth;
+#ifdef W1_X86
+  if (cpuSupportsAvx2())
+    projectAvx2(projection, depth, colorU, colorV, begin, end);
+  else
+    projectScalar(projection, depth, colorU, colorV, begin, end);
+#else
+  projectScalar(projection, depth, colorU, colorV, begin, end);
+#endif
+  for (int row = depthRows.begin; row < depthRows.end; ++row) {
+    float minV = FLT_MAX;
+    float maxV = -FLT_MAX;
+    for (int i = row * DepthWidth; i < (row + 1) * DepthWidth; ++i) {
+      if (depth[i] == 0)
+        continue;
+      // comparisons with NaN are false, so a degenerate projection doesn't count
+      if (colorV[i] < minV)
+        minV = colorV[i];
+      if (colorV[i] > maxV)
+        maxV = colorV[i];
+    }
+    rowMinV[row] = minV;
+    rowMaxV[row] = maxV;
+  }
+}
+
+
+void CoordinateMapperPrivate::splat(const QRect &colorRect)
+{
+  const float left = float(colorRect.left());
+  const float right = float(colorRect.right() + 1);
+  const float top = float(colorRect.top());
+  const float bottom = float(colorRect.bottom() + 1);
+  DSP invalid;
+  invalid.x = -1;
+  invalid.y = -1;
+  for (int y = colorRect.top(); y <= colorRect.bottom(); ++y) {
+    const int begin = colorRect.left() + y * ColorWidth;
+    std::fill(zBuffer + begin, zBuffer + begin + colorRect.width(), UINT16(USHRT_MAX));
+    std::fill(dsp + begin, dsp + begin + colorRect.width(), invalid);
+  }
+  for (int row = 0; row < DepthHeight; ++row) {
+    if (!(rowMaxV[row] + maxFootprintV >= top && rowMinV[row] - maxFootprintV < bottom))
+      continue;
+    for (int col = 0; col < DepthWidth; ++col) {
+      const int i = col + row * DepthWidth;
+      const UINT16 z = depth[i];
+      const float u = colorU[i];
+      const float v = colorV[i];
+      const float fu = footprintU[i];
+      const float fv = footprintV[i];
+      // written as they are to also reject NaNs and infinities
+      if (z == 0 || !(v + fv >= top && v - fv < bottom) || !(u + fu >= left && u - fu < right))
+        continue;
+      const int x0 = qMax(colorRect.left(), int(std::ceil(u - fu)));
+      const int x1 = qMin(colorRect.right(), int(std::floor(u + fu)));
+      const int y0 = qMax(colorRect.top(), int(std::ceil(v - fv)));
+      const int y1 = qMin(colorRect.bottom(), int(std::floor(v + fv)));
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          const int colorIndex = x + y * ColorWidth;
+          if (z < zBuffer[colorIndex]) {
+            zBuffer[colorIndex] = z;
+            dsp[colorIndex].x = INT16(col);
+            dsp[colorIndex].y = INT16(row);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void CoordinateMapperPrivate::markColorTiles(float u, float v, int i, bool *dirty) const
+{
+  // written as it is to also reject NaNs and infinities
+  if (!(u + footprintU[i] >= 0.f && u - footprintU[i] < float(ColorWidth) && v + footprintV[i] >= 0.f && v - footprintV[i] < float(ColorHeight)))
+    return;
+  const int x0 = qMax(0, int(u - footprintU[i]) / ColorTileSize);
+  const int x1 = qMin(ColorTilesX - 1, int(u + footprintU[i]) / ColorTileSize);
+  const int y0 = qMax(0, int(v - footprintV[i]) / ColorTileSize);
+  const int y1 = qMin(ColorTilesY - 1, int(v + footprintV[i]) / ColorTileSize);
+  for (int y = y0; y <= y1; ++y)
+    for (int x = x0; x <= x1; ++x)
+      dirty[x + y * ColorTilesX] = true;
+}
+
+
+QVector<QRect> CoordinateMapperPrivate::changedColorRects(void)
+{
+  bool dirty[ColorTilesX * ColorTilesY];
+  std::fill(dirty, dirty + ColorTilesX * ColorTilesY, false);
+  for (int ty = 0; ty < DepthTilesY; ++ty) {
+    const int rowBegin = ty * DepthTileSize;
+    const int rowEnd = qMin(rowBegin + DepthTileSize, DepthHeight);
+    for (int tx = 0; tx < DepthTilesX; ++tx) {
+      const int colBegin = tx * DepthTileSize;
+      const int colEnd = qMin(colBegin + DepthTileSize, DepthWidth);
+      int changed = 0;
+      for (int row = rowBegin; row < rowEnd; ++row) {
+        for (int i = colBegin + row * DepthWidth; i < colEnd + row * DepthWidth; ++i) {
+          const int z0 = referenceDepth[i];
+          const int z1 = depth[i];
+          if ((z0 == 0) != (z1 == 0) || qAbs(z1 - z0) > tolerance)
+            ++changed;
+        }
+      }
+      if (changed <= DepthTileNoisePixels)
+        continue;
+      // the color pixels the tile covered are as stale as those it covers now
+      for (int row = rowBegin; row < rowEnd; ++row) {
+        for (int i = colBegin + row * DepthWidth; i < colEnd + row * DepthWidth; ++i) {
+          if (referenceDepth[i] != 0) {
+            const float z = float(referenceDepth[i]);
+            const float w = z * coeffW[i] + projection.offsetW;
+            markColorTiles((z * coeffU[i] + projection.offsetU) / w, (z * coeffV[i] + projection.offsetV) / w, i, dirty);
+          }
+          if (depth[i] != 0)
+            markColorTiles(colorU[i], colorV[i], i, dirty);
+        }
+        std::copy(depth + colBegin + row * DepthWidth, depth + colEnd + row * DepthWidth, referenceDepth + colBegin + row * DepthWidth);
+      }
+    }
+  }
+  // neighboring dirty tiles of a row are remapped in one go
+  QVector<QRect> rects;
+  for (int y = 0; y < ColorTilesY; ++y) {
+    for (int x = 0; x < ColorTilesX; ++x) {
+      if (!dirty[x + y * ColorTilesX])
+        continue;
+      const int begin = x;
+      while (x + 1 < ColorTilesX && dirty[x + 1 + y * ColorTilesX])
+        ++x;
+      rects.append(QRect(begin * ColorTileSize, y * ColorTileSize, (x + 1 - begin) * ColorTileSize, ColorTileSize));
+    }
+  }
+  return rects;
+}
+
+
+CoordinateMapper::CoordinateMapper(const SensorCalibration &calibration)
+  : d_ptr(new CoordinateMapperPrivate(calibration))
+{
+  // ...
+}
+
+
+CoordinateMapper::~CoordinateMapper()
+{
+  // ...
+}
+
+
+void CoordinateMapper::mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DSP *dsp)
+{
+  Q_D(CoordinateMapper);
+  d->depth = depthBuffer;
+  d->dsp = dsp;
+  // every band of color rows depends on all depth rows, hence two passes
+  QtConcurrent::blockingMap(d->depthBands, [d](Band &band) { d->project(band); });
+  QtConcurrent::blockingMap(d->colorBands, [d](QRect &band) { d->splat(band); });
+  std::copy(depthBuffer, depthBuffer + DepthSize, d->referenceDepth);
+  d->hasReference = true;
+  d->depth = nullptr;
+  d->dsp = nullptr;
+}
+
+
+QVector<QRect> CoordinateMapper::updateColorFrameMapping(const UINT16 *depthBuffer, DSP *dsp)
+{
+  Q_D(CoordinateMapper);
+  QVector<QRect> rects;
+  if (!d->hasReference || d->tolerance <= 0) {
+    mapColorFrameToDepthSpace(depthBuffer, dsp);
+    rects.append(QRect(0, 0, ColorWidth, ColorHeight));
+    return rects;
+  }
+  d->depth = depthBuffer;
+  d->dsp = dsp;
+  QtConcurrent::blockingMap(d->depthBands, [d](Band &band) { d->project(band); });
+  rects = d->changedColorRects();
+  QtConcurrent::blockingMap(rects, [d](QRect &rect) { d->splat(rect); });
+  d->depth = nullptr;
+  d->dsp = nullptr;
+  return rects;
+}
+
+
+void CoordinateMapper::setTolerance(int tolerance)
+{
+  Q_D(CoordinateMapper);
+  d->tolerance = tolerance;
+}
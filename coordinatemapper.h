@@ -0,0 +1,61 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __COORDINATEMAPPER_H_
+#define __COORDINATEMAPPER_H_
+
+#include <QScopedPointer>
+#include <QRect>
+#include <QVector>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+class CoordinateMapperPrivate;
+
+// Registers the color frame with the depth frame from a
+// SensorCalibration instead of through the SDK. Every depth pixel is
+// projected into the color frame and covers the color pixels within
+// its footprint, the nearest one winning; color pixels no depth pixel
+// covers are invalid. The projection works on 8 pixels at a time with
+// AVX2 if available; both passes are spread over all cores.
+class CoordinateMapper
+{
+public:
+  explicit CoordinateMapper(const SensorCalibration&);
+  ~CoordinateMapper();
+
+  // fills ColorSize DSPs for the given depth frame
+  void mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DSP *dsp);
+
+  // Expects dsp to hold the result of the previous call or of
+  // mapColorFrameToDepthSpace() and only remaps the color pixels that
+  // depth tiles which changed by more than the tolerance cover now or
+  // covered before. Returns the rectangles it remapped.
+  QVector<QRect> updateColorFrameMapping(const UINT16 *depthBuffer, DSP *dsp);
+  // in millimeters; 0 remaps everything every time
+  void setTolerance(int);
+
+private:
+  QScopedPointer<CoordinateMapperPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(CoordinateMapper)
+  Q_DISABLE_COPY(CoordinateMapper)
+};
+
+#endif // __COORDINATEMAPPER_H_
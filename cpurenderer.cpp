@@ -0,0 +1,508 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "util.h"
+#include "simd.h"
+#include "colorconversion.h"
+#include "cpurenderer.h"
+
+#include <cmath>
+
+#include <QThread>
+#include <QVector>
+#include <QVarLengthArray>
+#include <QtConcurrent>
+
+static const float LumaR = .2126f;
+static const float LumaG = .7152f;
+static const float LumaB = .0722f;
+// makes the signed 16 bit compares of SSE2 order depths like unsigned ones
+static const quint16 DepthBias = 0x8000;
+
+
+struct Band {
+  int begin;
+  int end;
+};
+
+
+static QVector<Band> makeBands(int rows, int count)
+{
+  QVector<Band> bands;
+  for (int i = 0; i < count; ++i) {
+    Band band;
+    band.begin = rows * i / count;
+    band.end = rows * (i + 1) / count;
+    bands.append(band);
+  }
+  return bands;
+}
+
+
+// what the uniforms of the mix shader hold, with gamma, saturation and
+// contrast folded into a table and three factors:
+//   contrast * (mix(luma, c, saturation) - .5) + .5
+//     = colorFactor * c + lumaFactor * luma + offset
+struct MixParameters {
+  // pow(i / 255, 1 / gamma) for every 8 bit level i
+  const float *gamma;
+  // nearest | farthest << 16 within the halo of every depth pixel
+  const quint32 *depthRange;
+  float nearThreshold;
+  float farThreshold;
+  float colorFactor;
+  float lumaFactor;
+  float offset;
+  bool ignoreDepth;
+};
+
+
+static inline bool depthInRange(const DSP &dsp, const MixParameters &p)
+{
+  if (dsp.x < 0 || dsp.y < 0 || dsp.x >= DepthWidth || dsp.y >= DepthHeight)
+    return false;
+  const quint32 range = p.depthRange[dsp.x + dsp.y * DepthWidth];
+  return float(range & 0xffff) >= p.nearThreshold && float(range >> 16) <= p.farThreshold;
+}
+
+
+// rounds half to even like cvtps2dq does
+static inline int toLevel(float c)
+{
+  return int(std::lrint(clamp(c, 0.f, 1.f) * 255.f));
+}
+
+
+// The vector kernels evaluate the same expressions in the same order,
+// so their results are identical to these.
+static void mixScalar(const QRgb *color, const DSP *map, const QRgb *previous, QRgb *dst, int count, const MixParameters &p)
+{
+  for (int i = 0; i < count; ++i) {
+    if (!p.ignoreDepth && !depthInRange(map[i], p)) {
+      dst[i] = previous[i];
+      continue;
+    }
+    const float r = p.gamma[qRed(color[i])];
+    const float g = p.gamma[qGreen(color[i])];
+    const float b = p.gamma[qBlue(color[i])];
+    const float luma = p.lumaFactor * (LumaR * r + LumaG * g + LumaB * b) + p.offset;
+    dst[i] = qRgb(toLevel(p.colorFactor * r + luma), toLevel(p.colorFactor * g + luma), toLevel(p.colorFactor * b + luma));
+  }
+}
+
+
+// the element-wise minimum of nearRows[0..count - 1] and maximum of
+// farRows[0..count - 1] from column begin to end
+static void filterRowsScalar(const qint16 *const *nearRows, const qint16 *const *farRows, int count, qint16 *nearest, qint16 *farthest, int begin, int end)
+{
+  for (int x = begin; x < end; ++x) {
+    qint16 n = nearRows[0][x];
+    qint16 f = farRows[0][x];
+    for (int i = 1; i < count; ++i) {
+      n = qMin(n, nearRows[i][x]);
+      f = qMax(f, farRows[i][x]);
+    }
+    nearest[x] = n;
+    farthest[x] = f;
+  }
+}
+
+
+#ifdef W1_X86
+
+static inline __m128i toLevelsSse2(__m128 c)
+{
+  return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(1.f)), _mm_set1_ps(255.f)));
+}
+
+
+// Without a gather instruction the table and depth range lookups stay
+// scalar; the arithmetic is done on four pixels at a time.
+static void mixSse2(const QRgb *color, const DSP *map, const QRgb *previous, QRgb *dst, int count, const MixParameters &p)
+{
+  const __m128 lumaR = _mm_set1_ps(LumaR);
+  const __m128 lumaG = _mm_set1_ps(LumaG);
+  const __m128 lumaB = _mm_set1_ps(LumaB);
+  const __m128 colorFactor = _mm_set1_ps(p.colorFactor);
+  const __m128 lumaFactor = _mm_set1_ps(p.lumaFactor);
+  const __m128 offset = _mm_set1_ps(p.offset);
+  const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+  const int vectorCount = count & ~3;
+  for (int i = 0; i < vectorCount; i += 4) {
+    const QRgb *c = color + i;
+    const __m128i valid = _mm_set_epi32(
+          p.ignoreDepth || depthInRange(map[i + 3], p) ? -1 : 0,
+          p.ignoreDepth || depthInRange(map[i + 2], p) ? -1 : 0,
+          p.ignoreDepth || depthInRange(map[i + 1], p) ? -1 : 0,
+          p.ignoreDepth || depthInRange(map[i], p) ? -1 : 0);
+    const __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+    // nothing to compute where only the previous image shows through
+    if (_mm_movemask_epi8(valid) == 0) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), before);
+      continue;
+    }
+    const __m128 r = _mm_set_ps(p.gamma[qRed(c[3])], p.gamma[qRed(c[2])], p.gamma[qRed(c[1])], p.gamma[qRed(c[0])]);
+    const __m128 g = _mm_set_ps(p.gamma[qGreen(c[3])], p.gamma[qGreen(c[2])], p.gamma[qGreen(c[1])], p.gamma[qGreen(c[0])]);
+    const __m128 b = _mm_set_ps(p.gamma[qBlue(c[3])], p.gamma[qBlue(c[2])], p.gamma[qBlue(c[1])], p.gamma[qBlue(c[0])]);
+    const __m128 luma = _mm_add_ps(_mm_mul_ps(lumaFactor, _mm_add_ps(_mm_add_ps(_mm_mul_ps(lumaR, r), _mm_mul_ps(lumaG, g)), _mm_mul_ps(lumaB, b))), offset);
+    const __m128i mixed = _mm_or_si128(
+          _mm_or_si128(alpha, _mm_slli_epi32(toLevelsSse2(_mm_add_ps(_mm_mul_ps(colorFactor, r), luma)), 16)),
+          _mm_or_si128(_mm_slli_epi32(toLevelsSse2(_mm_add_ps(_mm_mul_ps(colorFactor, g), luma)), 8),
+                       toLevelsSse2(_mm_add_ps(_mm_mul_ps(colorFactor, b), luma))));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_and_si128(valid, mixed), _mm_andnot_si128(valid, before)));
+  }
+  mixScalar(color + vectorCount, map + vectorCount, previous + vectorCount, dst + vectorCount, count - vectorCount, p);
+}
+
+
+W1_TARGET_AVX2
+static inline __m256i toLevelsAvx2(__m256 c)
+{
+  return _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(1.f)), _mm256_set1_ps(255.f)));
+}
+
+
+// Eight pixels at a time, with the table and the depth ranges gathered.
+// A DSP loads as x | y << 16; the range is only gathered for lanes
+// that point into the depth frame.
+W1_TARGET_AVX2
+static void mixAvx2(const QRgb *color, const DSP *map, const QRgb *previous, QRgb *dst, int count, const MixParameters &p)
+{
+  const __m256i byteMask = _mm256_set1_epi32(0xff);
+  const __m256i wordMask = _mm256_set1_epi32(0xffff);
+  const __m256i minusOne = _mm256_set1_epi32(-1);
+  const __m256i depthWidth = _mm256_set1_epi32(DepthWidth);
+  const __m256i depthHeight = _mm256_set1_epi32(DepthHeight);
+  const __m256i ignoreDepth = _mm256_set1_epi32(p.ignoreDepth ? -1 : 0);
+  const __m256 nearThreshold = _mm256_set1_ps(p.nearThreshold);
+  const __m256 farThreshold = _mm256_set1_ps(p.farThreshold);
+  const __m256 lumaR = _mm256_set1_ps(LumaR);
+  const __m256 lumaG = _mm256_set1_ps(LumaG);
+  const __m256 lumaB = _mm256_set1_ps(LumaB);
+  const __m256 colorFactor = _mm256_set1_ps(p.colorFactor);
+  const __m256 lumaFactor = _mm256_set1_ps(p.lumaFactor);
+  const __m256 offset = _mm256_set1_ps(p.offset);
+  const __m256i alpha = _mm256_set1_epi32(int(0xff000000));
+  const int *depthRange = reinterpret_cast<const int*>(p.depthRange);
+  const int vectorCount = count & ~7;
+  for (int i = 0; i < vectorCount; i += 8) {
+    const __m256i dsp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(map + i));
+    const __m256i x = _mm256_srai_epi32(_mm256_slli_epi32(dsp, 16), 16);
+    const __m256i y = _mm256_srai_epi32(dsp, 16);
+    const __m256i inside = _mm256_and_si256(
+          _mm256_and_si256(_mm256_cmpgt_epi32(x, minusOne), _mm256_cmpgt_epi32(y, minusOne)),
+          _mm256_and_si256(_mm256_cmpgt_epi32(depthWidth, x), _mm256_cmpgt_epi32(depthHeight, y)));
+    const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y, depthWidth), x);
+    const __m256i range = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), depthRange, index, inside, 4);
+    const __m256 nearest = _mm256_cvtepi32_ps(_mm256_and_si256(range, wordMask));
+    const __m256 farthest = _mm256_cvtepi32_ps(_mm256_srli_epi32(range, 16));
+    const __m256i inRange = _mm256_and_si256(
+          _mm256_castps_si256(_mm256_cmp_ps(nearest, nearThreshold, _CMP_GE_OQ)),
+          _mm256_castps_si256(_mm256_cmp_ps(farthest, farThreshold, _CMP_LE_OQ)));
+    const __m256i valid = _mm256_or_si256(ignoreDepth, _mm256_and_si256(inside, inRange));
+    const __m256i before = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + i));
+    if (_mm256_testz_si256(valid, valid)) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), before);
+      continue;
+    }
+
+    const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(color + i));
+    const __m256 r = _mm256_i32gather_ps(p.gamma, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask), 4);
+    const __m256 g = _mm256_i32gather_ps(p.gamma, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask), 4);
+    const __m256 b = _mm256_i32gather_ps(p.gamma, _mm256_and_si256(pixels, byteMask), 4);
+    const __m256 luma = _mm256_add_ps(_mm256_mul_ps(lumaFactor, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lumaR, r), _mm256_mul_ps(lumaG, g)), _mm256_mul_ps(lumaB, b))), offset);
+    const __m256i mixed = _mm256_or_si256(
+          _mm256_or_si256(alpha, _mm256_slli_epi32(toLevelsAvx2(_mm256_add_ps(_mm256_mul_ps(colorFactor, r), luma)), 16)),
+          _mm256_or_si256(_mm256_slli_epi32(toLevelsAvx2(_mm256_add_ps(_mm256_mul_ps(colorFactor, g), luma)), 8),
+                          toLevelsAvx2(_mm256_add_ps(_mm256_mul_ps(colorFactor, b), luma))));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_blendv_epi8(before, mixed, valid));
+  }
+  mixSse2(color + vectorCount, map + vectorCount, previous + vectorCount, dst + vectorCount, count - vectorCount, p);
+}
+
+
+static void filterRowsSse2(const qint16 *const *nearRows, const qint16 *const *farRows, int count, qint16 *nearest, qint16 *farthest, int width)
+{
+  const int vectorCount = width & ~7;
+  for (int x = 0; x < vectorCount; x += 8) {
+    __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i*>(nearRows[0] + x));
+    __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(farRows[0] + x));
+    for (int i = 1; i < count; ++i) {
+      n = _mm_min_epi16(n, _mm_loadu_si128(reinterpret_cast<const __m128i*>(nearRows[i] + x)));
+      f = _mm_max_epi16(f, _mm_loadu_si128(reinterpret_cast<const __m128i*>(farRows[i] + x)));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(nearest + x), n);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(farthest + x), f);
+  }
+  filterRowsScalar(nearRows, farRows, count, nearest, farthest, vectorCount, width);
+}
+
+#endif // W1_X86
+
+
+static void mix(const QRgb *color, const DSP *map, const QRgb *previous, QRgb *dst, int count, const MixParameters &p)
+{
+#ifdef W1_X86
+  if (cpuSupportsAvx2())
+    mixAvx2(color, map, previous, dst, count, p);
+  else
+    mixSse2(color, map, previous, dst, count, p);
+#else
+  mixScalar(color, map, previous, dst, count, p);
+#endif
+}
+
+
+static void filterRows(const qint16 *const *nearRows, const qint16 *const *farRows, int count, qint16 *nearest, qint16 *farthest, int width)
+{
+#ifdef W1_X86
+  filterRowsSse2(nearRows, farRows, count, nearest, farthest, width);
+#else
+  filterRowsScalar(nearRows, farRows, count, nearest, farthest, 0, width);
+#endif
+}
+
+
+class CpuRendererPrivate {
+public:
+  CpuRendererPrivate(void)
+    : gammaTable(256)
+    , horizontalNearest(DepthSize)
+    , horizontalFarthest(DepthSize)
+    , depthRange(DepthSize)
+    , imageIndex(0)
+    , contrast(1.f)
+    , saturation(1.f)
+    , nearThreshold(0.f)
+    , farThreshold(float(USHRT_MAX))
+    , haloRadiusX(0)
+    , haloRadiusY(0)
+    , frameCount(0)
+  {
+    for (int i = 0; i < 2; ++i) {
+      images[i] = QImage(ColorWidth, ColorHeight, QImage::Format_RGB32);
+      images[i].fill(Qt::black);
+    }
+    const int threads = qMax(1, QThread::idealThreadCount());
+    depthBands = makeBands(DepthHeight, threads);
+    // more bands than threads even out the work when some are busy
+    colorBands = makeBands(ColorHeight, 4 * threads);
+  }
+
+  void filterDepthRange(void);
+  void mixBand(const Band &rows, const MixParameters &p, const QRgb *previous, QRgb *dst);
+
+  QVector<float> gammaTable;
+  // the horizontal pass of the min/max filter, biased by DepthBias
+  QVector<qint16> horizontalNearest;
+  QVector<qint16> horizontalFarthest;
+  QVector<quint32> depthRange;
+  // an all invalid mapping for as long as the frame sets carry none
+  QVector<DSP> noMapping;
+
+  // rendered into alternately, the other one holding the previous image
+  QImage images[2];
+  int imageIndex;
+
+  DepthFrameRef depth;
+  ColorFrameRef color;
+  MappingFrameRef mapping;
+
+  QVector<Band> depthBands;
+  QVector<Band> colorBands;
+
+  float contrast;
+  float saturation;
+  float nearThreshold;
+  float farThreshold;
+  int haloRadiusX;
+  int haloRadiusY;
+  int frameCount;
+};
+
+
+// Like shaders/depthrange.fs.glsl: a horizontal and a vertical pass of
+// the separable minimum and maximum filter, with the borders clamped.
+void CpuRendererPrivate::filterDepthRange(void)
+{
+  const UINT16 *src = depth->buffer;
+  QtConcurrent::blockingMap(depthBands, [this, src](Band &band) {
+    QVector<qint16> padded(DepthWidth + 2 * haloRadiusX);
+    QVarLengthArray<const qint16*, 32> rows;
+    for (int i = 0; i <= 2 * haloRadiusX; ++i)
+      rows.append(padded.constData() + i);
+    for (int y = band.begin; y < band.end; ++y) {
+      const UINT16 *line = src + y * DepthWidth;
+      for (int x = 0; x < padded.count(); ++x)
+        padded[x] = qint16(line[clamp(x - haloRadiusX, 0, DepthWidth - 1)] ^ DepthBias);
+      filterRows(rows.constData(), rows.constData(), rows.count(),
+                 horizontalNearest.data() + y * DepthWidth, horizontalFarthest.data() + y * DepthWidth, DepthWidth);
+    }
+  });
+  QtConcurrent::blockingMap(depthBands, [this](Band &band) {
+    QVector<qint16> nearest(DepthWidth);
+    QVector<qint16> farthest(DepthWidth);
+    QVarLengthArray<const qint16*, 32> nearRows;
+    QVarLengthArray<const qint16*, 32> farRows;
+    for (int y = band.begin; y < band.end; ++y) {
+      nearRows.clear();
+      farRows.clear();
+      for (int i = -haloRadiusY; i <= haloRadiusY; ++i) {
+        const int row = clamp(y + i, 0, DepthHeight - 1);
+        nearRows.append(horizontalNearest.constData() + row * DepthWidth);
+        farRows.append(horizontalFarthest.constData() + row * DepthWidth);
+      }
+      filterRows(nearRows.constData(), farRows.constData(), nearRows.count(), nearest.data(), farthest.data(), DepthWidth);
+      quint32 *range = depthRange.data() + y * DepthWidth;
+      for (int x = 0; x < DepthWidth; ++x)
+        range[x] = quint32(quint16(nearest.at(x)) ^ DepthBias) | (quint32(quint16(farthest.at(x)) ^ DepthBias) << 16);
+    }
+  });
+}
+
+
+void CpuRendererPrivate::mixBand(const Band &rows, const MixParameters &p, const QRgb *previous, QRgb *dst)
+{
+  const DSP *map = mapping.isNull() ? noMapping.constData() : mapping->buffer;
+  QVector<QRgb> converted;
+  if (color->format == ColorFormatYuy2)
+    converted.resize(ColorWidth);
+  for (int y = rows.begin; y < rows.end; ++y) {
+    const int offset = y * ColorWidth;
+    const QRgb *line = color->buffer + offset;
+    if (color->format == ColorFormatYuy2) {
+      // a macropixel per element, see ColorFrameData
+      yuy2ToBgra(reinterpret_cast<const uchar*>(color->buffer + offset / 2), converted.data(), ColorWidth);
+      line = converted.constData();
+    }
+    mix(line, map + offset, previous + offset, dst + offset, ColorWidth, p);
+  }
+}
+
+
+CpuRenderer::CpuRenderer(void)
+  : d_ptr(new CpuRendererPrivate)
+{
+  setGamma(1.f);
+}
+
+
+CpuRenderer::~CpuRenderer()
+{
+  // ...
+}
+
+
+void CpuRenderer::process(const FrameSet &frameSet)
+{
+  Q_D(CpuRenderer);
+  Q_ASSERT_X(!frameSet.isNull(), "CpuRenderer::process()", "frame set must not be null");
+  d->depth = frameSet.depth;
+  d->color = frameSet.color;
+  // like the map texture, the previous mapping stays if there's none
+  if (!frameSet.mapping.isNull())
+    d->mapping = frameSet.mapping;
+  else if (d->mapping.isNull() && d->noMapping.isEmpty()) {
+    DSP invalid;
+    invalid.x = -1;
+    invalid.y = -1;
+    d->noMapping.fill(invalid, ColorSize);
+  }
+  d->filterDepthRange();
+  ++d->frameCount;
+}
+
+
+void CpuRenderer::renderImage(void)
+{
+  Q_D(CpuRenderer);
+  if (d->frameCount == 0)
+    return;
+  MixParameters p;
+  p.gamma = d->gammaTable.constData();
+  p.depthRange = d->depthRange.constData();
+  p.nearThreshold = d->nearThreshold;
+  p.farThreshold = d->farThreshold;
+  p.colorFactor = d->contrast * d->saturation;
+  p.lumaFactor = d->contrast * (1.f - d->saturation);
+  p.offset = .5f * (1.f - d->contrast);
+  // the first frame set has nothing to fall back to
+  p.ignoreDepth = d->frameCount < 2;
+  const QRgb *previous = reinterpret_cast<const QRgb*>(d->images[1 - d->imageIndex].constBits());
+  QRgb *dst = reinterpret_cast<QRgb*>(d->images[d->imageIndex].bits());
+  QtConcurrent::blockingMap(d->colorBands, [d, &p, previous, dst](Band &band) {
+    d->mixBand(band, p, previous, dst);
+  });
+  d->imageIndex = 1 - d->imageIndex;
+}
+
+
+QImage CpuRenderer::image(void)
+{
+  Q_D(CpuRenderer);
+  return d->images[1 - d->imageIndex];
+}
+
+
+void CpuRenderer::setContrast(float contrast)
+{
+  Q_D(CpuRenderer);
+  d->contrast = contrast;
+}
+
+
+void CpuRenderer::setSaturation(float saturation)
+{
+  Q_D(CpuRenderer);
+  d->saturation = saturation;
+}
+
+
+void CpuRenderer::setGamma(float gamma)
+{
+  Q_D(CpuRenderer);
+  for (int i = 0; i < d->gammaTable.count(); ++i)
+    d->gammaTable[i] = std::pow(float(i) / 255.f, 1.f / gamma);
+}
+
+
+void CpuRenderer::setNearThreshold(float nearThreshold)
+{
+  Q_D(CpuRenderer);
+  d->nearThreshold = nearThreshold;
+}
+
+
+void CpuRenderer::setFarThreshold(float farThreshold)
+{
+  Q_D(CpuRenderer);
+  d->farThreshold = farThreshold;
+}
+
+
+void CpuRenderer::setHaloSize(int s)
+{
+  Q_D(CpuRenderer);
+  // the same rectangle as FrameRenderer::setHaloSize()
+  d->haloRadiusX = (s + s / 2) / 2;
+  d->haloRadiusY = s / 2;
+  if (d->frameCount > 0)
+    d->filterDepthRange();
+}
@@ -0,0 +1,58 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __CPURENDERER_H_
+#define __CPURENDERER_H_
+
+#include <QScopedPointer>
+
+#include "removalengine.h"
+
+class CpuRendererPrivate;
+
+// The RemovalEngine on the CPU, for hosts without a usable OpenGL
+// stack. Computes what shaders/mix.fs.glsl does, in bands of rows on
+// the global thread pool with SSE2 or AVX2 inner loops. Needs the
+// frame sets to carry a mapping. YUY2 frames are converted with the
+// SDK's integer formula, so they may differ from the GPU's output by
+// a few levels.
+class CpuRenderer : public RemovalEngine
+{
+public:
+  CpuRenderer(void);
+  ~CpuRenderer();
+
+  virtual void process(const FrameSet&);
+  virtual void renderImage(void);
+  virtual QImage image(void);
+
+  virtual void setContrast(float);
+  virtual void setSaturation(float);
+  virtual void setGamma(float);
+  virtual void setNearThreshold(float);
+  virtual void setFarThreshold(float);
+  virtual void setHaloSize(int);
+
+private:
+  QScopedPointer<CpuRendererPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(CpuRenderer)
+  Q_DISABLE_COPY(CpuRenderer)
+};
+
+#endif // __CPURENDERER_H_
@@ -107,13 +107,11 @@ void DepthWidget::paintEvent(QPaintEvent *)
 }
 
 
-void DepthWidget::setDepthData(INT64 nTime, const UINT16 *pBuffer, int nWidth, int nHeight, int nMinDepth, int nMaxDepth)
+void DepthWidget::setDepthFrame(const DepthFrameRef &frame)
 {
   Q_D(DepthWidget);
-  Q_UNUSED(nTime);
-  Q_UNUSED(nMinDepth);
 
-  if (nWidth != DepthWidth || nHeight != DepthHeight || pBuffer == nullptr)
+  if (frame.isNull() || frame->width != DepthWidth || frame->height != DepthHeight)
     return;
 
   const qint64 ms = d->timer.elapsed();
@@ -126,6 +124,8 @@ void DepthWidget::setDepthData(INT64 nTime, const UINT16 *pBuffer, int nWidth, i
     fpsSum += d->fpsArray.at(i);
   d->fps = fpsSum / d->fpsArray.count();
 
+  const int nMaxDepth = frame->maxReliableDistance;
+  const UINT16 *pBuffer = frame->buffer;
   const UINT16 *const pBufferEnd = pBuffer + DepthSize;
   QRgb *dst = reinterpret_cast<QRgb*>(d->depthFrame.bits());
   while (pBuffer < pBufferEnd) {
@@ -20,7 +20,8 @@
 #ifndef __DEPTHWIDGET_H_
 #define __DEPTHWIDGET_H_
 
-#include <Kinect.h>
+#include "kinectcompat.h"
+#include "frameset.h"
 
 #include <QWidget>
 #include <QPaintEvent>
@@ -34,7 +35,7 @@ class DepthWidget : public QWidget
   Q_OBJECT
 public:
   explicit DepthWidget(QWidget *parent = nullptr);
-  void setDepthData(INT64 nTime, const UINT16* pBuffer, int nWidth, int nHeight, int nMinDepth, int nMaxDepth);
+  void setDepthFrame(const DepthFrameRef&);
 
 signals:
 
@@ -0,0 +1,181 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMEPOOL_H_
+#define __FRAMEPOOL_H_
+
+#include <type_traits>
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+#include "util.h"
+
+template <typename FrameData> class FramePool;
+
+
+template <typename FrameData>
+struct PooledFrame {
+  FrameData data;
+  QAtomicInt refCount;
+  FramePool<FrameData> *pool;
+};
+
+
+// Shared, reference-counted handle to a frame from a FramePool. The
+// frame goes back to its pool when the last reference is dropped.
+// Only the one who acquired the frame from the pool may write into it,
+// and only until the first copy of the reference is handed on; from
+// then on the frame is immutable, so it can be read from any thread.
+template <typename FrameData>
+class FrameRef
+{
+public:
+  FrameRef(void)
+    : mFrame(nullptr)
+  { /* ... */ }
+  FrameRef(const FrameRef &other)
+    : mFrame(other.mFrame)
+  {
+    if (mFrame != nullptr)
+      mFrame->refCount.ref();
+  }
+  FrameRef(FrameRef &&other)
+    : mFrame(other.mFrame)
+  {
+    other.mFrame = nullptr;
+  }
+  ~FrameRef()
+  {
+    reset();
+  }
+  FrameRef &operator=(const FrameRef &other)
+  {
+    if (other.mFrame != nullptr)
+      other.mFrame->refCount.ref();
+    reset();
+    mFrame = other.mFrame;
+    return *this;
+  }
+  FrameRef &operator=(FrameRef &&other)
+  {
+    if (this != &other) {
+      reset();
+      mFrame = other.mFrame;
+      other.mFrame = nullptr;
+    }
+    return *this;
+  }
+
+  bool isNull(void) const { return mFrame == nullptr; }
+  const FrameData *operator->(void) const { return &mFrame->data; }
+  const FrameData &operator*(void) const { return mFrame->data; }
+
+  FrameData &writable(void)
+  {
+    Q_ASSERT_X(mFrame != nullptr && mFrame->refCount.load() == 1, "FrameRef::writable()", "frame is shared");
+    return mFrame->data;
+  }
+
+  void reset(void)
+  {
+    if (mFrame != nullptr && !mFrame->refCount.deref())
+      mFrame->pool->recycle(mFrame);
+    mFrame = nullptr;
+  }
+
+private:
+  friend class FramePool<FrameData>;
+  explicit FrameRef(PooledFrame<FrameData> *frame)
+    : mFrame(frame)
+  { /* ... */ }
+
+  PooledFrame<FrameData> *mFrame;
+};
+
+
+// Preallocated frames of one stream. acquire() only allocates if all
+// frames are in use, so the pool settles at the number of frames that
+// are in flight at the same time and then stops allocating.
+template <typename FrameData>
+class FramePool
+{
+public:
+  typedef typename std::remove_pointer<decltype(FrameData::buffer)>::type Element;
+
+  FramePool(int bufferSize, int preallocated)
+    : mBufferSize(bufferSize)
+  {
+    mFrames.reserve(2 * preallocated);
+    mFree.reserve(2 * preallocated);
+    for (int i = 0; i < preallocated; ++i)
+      mFree.append(allocate());
+  }
+  ~FramePool()
+  {
+    Q_ASSERT_X(mFree.count() == mFrames.count(), "FramePool::~FramePool()", "frames still in use");
+    for (int i = 0; i < mFrames.count(); ++i) {
+      SafeDeleteArray(mFrames[i]->data.buffer);
+      delete mFrames[i];
+    }
+  }
+
+  FrameRef<FrameData> acquire(void)
+  {
+    QMutexLocker lock(&mMutex);
+    PooledFrame<FrameData> *frame = mFree.isEmpty() ? allocate() : mFree.takeLast();
+    frame->refCount.store(1);
+    return FrameRef<FrameData>(frame);
+  }
+
+  int count(void) const
+  {
+    QMutexLocker lock(&mMutex);
+    return mFrames.count();
+  }
+
+private:
+  friend class FrameRef<FrameData>;
+
+  PooledFrame<FrameData> *allocate(void)
+  {
+    PooledFrame<FrameData> *frame = new PooledFrame<FrameData>;
+    frame->data.buffer = new Element[mBufferSize];
+    frame->pool = this;
+    mFrames.append(frame);
+    return frame;
+  }
+
+  void recycle(PooledFrame<FrameData> *frame)
+  {
+    QMutexLocker lock(&mMutex);
+    mFree.append(frame);
+  }
+
+  const int mBufferSize;
+  mutable QMutex mMutex;
+  QVector<PooledFrame<FrameData>*> mFrames;
+  QVector<PooledFrame<FrameData>*> mFree;
+
+  Q_DISABLE_COPY(FramePool)
+};
+
+#endif // __FRAMEPOOL_H_
@@ -0,0 +1,1201 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "util.h"
+#include "framerenderer.h"
+
+#include <QDebug>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLContext>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QHash>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include <QRect>
+
+#include <cmath>
+#include <cstring>
+
+
+static const int PROGRAM_VERTEX_ATTRIBUTE = 0;
+static const int PROGRAM_TEXCOORD_ATTRIBUTE = 1;
+static const int SPLAT_DEPTH_PIXEL_ATTRIBUTE = 0;
+static const QVector2D Vertices4FBO[4] = {
+  QVector2D(-1.f, -1.f),
+  QVector2D(-1.f, +1.f),
+  QVector2D(+1.f, -1.f),
+  QVector2D(+1.f, +1.f)
+};
+static const QVector2D TexCoords[4] = {
+  QVector2D(0, 0),
+  QVector2D(0, 1),
+  QVector2D(1, 0),
+  QVector2D(1, 1)
+};
+// the vertex buffer holds the quad followed by its texture coordinates
+static const qptrdiff OffscreenVerticesOffset = 0;
+static const qptrdiff TexCoordsOffset = OffscreenVerticesOffset + sizeof(Vertices4FBO);
+static const int QuadBufferSize = int(TexCoordsOffset + sizeof(TexCoords));
+
+
+// a staging buffer takes a BGRA color frame, a depth frame and a mapping
+static const qptrdiff ColorUploadOffset = 0;
+static const qptrdiff DepthUploadOffset = ColorUploadOffset + ColorSize * sizeof(QRgb);
+static const qptrdiff MappingUploadOffset = DepthUploadOffset + DepthSize * sizeof(UINT16);
+static const GLsizeiptr UploadBufferSize = MappingUploadOffset + ColorSize * sizeof(DSP);
+// in nanoseconds
+static const GLuint64 UploadFenceTimeout = 1000000000;
+
+// the Parameters uniform block of mix.fs.glsl, in std140 layout and
+// padded to a multiple of a vec4
+struct MixParameters {
+  GLfloat gamma;
+  GLfloat contrast;
+  GLfloat saturation;
+  GLfloat nearThreshold;
+  GLfloat farThreshold;
+  GLfloat reserved[3];
+};
+static const GLuint MixParametersBinding = 0;
+
+
+static inline const GLvoid *bufferOffset(qptrdiff offset)
+{
+  return reinterpret_cast<const GLvoid*>(offset);
+}
+
+
+class FrameRendererPrivate {
+public:
+  FrameRendererPrivate(void)
+    : lastImageFBOIndex(ImageFBOCount - 1)
+    , presentedTexture(0)
+    , quadBuffer(QOpenGLBuffer::VertexBuffer)
+    , shaderProgram(nullptr)
+    , shaderVariant(-1)
+    , parametersBuffer(0)
+    , dirty(0)
+    , processingScale(1)
+    , maskProgram(nullptr)
+    , maskTextureHandle(0)
+    , maskFBO(0)
+    , hasProgramBinary(false)
+    , haloRadiusX(0)
+    , haloRadiusY(0)
+    , horizontalDepthRangeProgram(nullptr)
+    , verticalDepthRangeProgram(nullptr)
+    , videoTextureHandle(0)
+    , depthTextureHandle(0)
+    , mapTextureHandle(0)
+    , mappingSequence(0)
+    , uploadIndex(0)
+    , hasTextureStorage(false)
+    , frameCount(0)
+    , colorFormat(ColorFormatBgra)
+    , forwardMapping(false)
+    , hasCalibration(false)
+    , splatProgram(nullptr)
+    , dilateProgram(nullptr)
+    , depthPixelBuffer(QOpenGLBuffer::VertexBuffer)
+    , splatPointSize(1.f)
+    , projectionTextureHandle(0)
+    , splatTextureHandle(0)
+    , splatDepthBufferHandle(0)
+    , splatFBO(0)
+    , mapFBO(0)
+    , timer(QStringList()
+            << "color upload"
+            << "depth upload"
+            << "mapping upload"
+            << "depth range"
+            << "splat"
+            << "mask"
+            << "mix")
+  {
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.gamma = 1.f;
+    parameters.contrast = 1.f;
+    parameters.saturation = 1.f;
+    for (int i = 0; i < ImageFBOCount; ++i)
+      imageFBOs[i] = nullptr;
+    for (int i = 0; i < UploadBufferCount; ++i) {
+      uploadBuffers[i] = 0;
+      uploadFences[i] = nullptr;
+    }
+    for (int i = 0; i < 2; ++i) {
+      depthRangeTextureHandles[i] = 0;
+      depthRangeFBOs[i] = 0;
+    }
+  }
+  ~FrameRendererPrivate()
+  {
+    qDeleteAll(depthRangePrograms);
+    SafeDelete(splatProgram);
+    SafeDelete(dilateProgram);
+    qDeleteAll(mixPrograms);
+    SafeDelete(maskProgram);
+    for (int i = 0; i < ImageFBOCount; ++i)
+      SafeDelete(imageFBOs[i]);
+  }
+
+  bool mixShaderProgramIsValid(void) const {
+    return shaderProgram != nullptr && shaderProgram->isLinked();
+  }
+
+  // Pixels without a valid depth show what was there before. The FBOs
+  // take turns: one is rendered into while another one holds the
+  // previous frame. The third one is left alone while another context
+  // draws it, see setPresentedTexture().
+  static const int ImageFBOCount = 3;
+  QOpenGLFramebufferObject *imageFBOs[ImageFBOCount];
+  int lastImageFBOIndex;
+  GLuint presentedTexture;
+  QOpenGLFramebufferObject *lastImageFBO(void) const {
+    return imageFBOs[lastImageFBOIndex];
+  }
+
+  // All vertices live in buffer objects on the GPU. offscreenQuad
+  // fills an FBO.
+  QOpenGLBuffer quadBuffer;
+  QOpenGLVertexArrayObject offscreenQuad;
+
+  // The mix shader is compiled in a variant for each combination of
+  // the stages it needs, so that a stage which is switched off costs
+  // nothing. shaderProgram is the one currently in use.
+  enum MixVariant {
+    IgnoreDepthVariant = 1,
+    VideoIsYuy2Variant = 2,
+    GammaVariant = 4,
+    SaturationVariant = 8,
+    ContrastVariant = 16,
+    UpsampledMaskVariant = 32
+  };
+  int mixVariant(void) const;
+  QHash<int, QOpenGLShaderProgram*> mixPrograms;
+  QOpenGLShaderProgram *shaderProgram;
+  int shaderVariant;
+
+  // The settings only take effect with the next image. Until then they
+  // are collected in the dirty set; the ones in the uniform block,
+  // which all variants share, are uploaded in one go.
+  enum Change {
+    ParametersChanged = 1,
+    HaloChanged = 2,
+    ScaleChanged = 4
+  };
+  MixParameters parameters;
+  GLuint parametersBuffer;
+  int dirty;
+
+  // With a processing scale above 1 the mix shader's MASK_PASS variant
+  // decides which pixels to keep at that fraction of the color
+  // resolution into the mask texture. The mix shader then blends the
+  // color in through the bilinearly upsampled mask, so that a halo test
+  // is done for every processingScale^2-th pixel only.
+  int processingScale;
+  QOpenGLShaderProgram *maskProgram;
+  GLuint maskTextureHandle;
+  GLuint maskFBO;
+
+  // Linked programs are kept on disk, so that they are loaded instead
+  // of compiled the next time. The file names are hashes of
+  // programCacheKey, which identifies the driver, and the sources.
+  bool hasProgramBinary;
+  QString programCacheDirectory;
+  QByteArray programCacheKey;
+
+  // Whether all depths within the halo around a depth pixel lie
+  // between the thresholds only depends on the nearest and farthest of
+  // them. These are found by a separable min/max filter at depth
+  // resolution into depthRangeTextureHandles[1], via the horizontal
+  // pass into depthRangeTextureHandles[0]. Each pass has its radius
+  // and direction compiled in; the programs are kept by both.
+  int haloRadiusX;
+  int haloRadiusY;
+  QHash<int, QOpenGLShaderProgram*> depthRangePrograms;
+  QOpenGLShaderProgram *horizontalDepthRangeProgram;
+  QOpenGLShaderProgram *verticalDepthRangeProgram;
+  GLuint depthRangeTextureHandles[2];
+  GLuint depthRangeFBOs[2];
+
+  GLuint videoTextureHandle;
+  GLuint depthTextureHandle;
+  GLuint mapTextureHandle;
+  // of the mapping in mapTextureHandle, 0 if there's none yet
+  quint64 mappingSequence;
+
+  // The textures are allocated once and updated from a ring of pixel
+  // buffer objects, so that the copy into the textures runs on the GPU
+  // while the next frame is staged. A buffer is reused only after the
+  // fence set behind its uploads has been passed.
+  static const int UploadBufferCount = 3;
+  GLuint uploadBuffers[UploadBufferCount];
+  GLsync uploadFences[UploadBufferCount];
+  int uploadIndex;
+  bool hasTextureStorage;
+
+  GLint imageTextureLocation;
+  GLint videoTextureLocation;
+  GLint depthRangeTextureLocation;
+  GLint mapTextureLocation;
+  GLint mvMatrixLocation;
+
+  int frameCount;
+  ColorFormat colorFormat;
+
+  // forward mapping: the depth pixels are splatted into splatFBO as
+  // points, then dilated into the map texture by rendering to mapFBO
+  bool forwardMapping;
+  bool hasCalibration;
+  QOpenGLShaderProgram *splatProgram;
+  QOpenGLShaderProgram *dilateProgram;
+  QOpenGLBuffer depthPixelBuffer;
+  QOpenGLVertexArrayObject splatPoints;
+  GLuint projectionTextureHandle;
+  GLuint splatTextureHandle;
+  GLuint splatDepthBufferHandle;
+  GLuint splatFBO;
+  GLuint mapFBO;
+  GLfloat splatPointSize;
+  GLint projectionOffsetLocation;
+
+  GpuTimer timer;
+};
+
+
+int FrameRendererPrivate::mixVariant(void) const
+{
+  int variant = 0;
+  // there's no previous frame to fill in from
+  if (frameCount < 2)
+    variant |= IgnoreDepthVariant;
+  if (colorFormat == ColorFormatYuy2)
+    variant |= VideoIsYuy2Variant;
+  if (parameters.gamma != 1.f)
+    variant |= GammaVariant;
+  if (parameters.saturation != 1.f)
+    variant |= SaturationVariant;
+  if (parameters.contrast != 1.f)
+    variant |= ContrastVariant;
+  if (processingScale > 1 && (variant & IgnoreDepthVariant) == 0)
+    variant |= UpsampledMaskVariant;
+  return variant;
+}
+
+
+FrameRenderer::FrameRenderer(void)
+  : d_ptr(new FrameRendererPrivate)
+{
+  // ...
+}
+
+
+FrameRenderer::~FrameRenderer()
+{
+  Q_D(FrameRenderer);
+  // the video texture is the first GL object initialize() makes
+  if (d->videoTextureHandle == 0)
+    return;
+  for (int i = 0; i < FrameRendererPrivate::UploadBufferCount; ++i) {
+    if (d->uploadFences[i] != nullptr)
+      glDeleteSync(d->uploadFences[i]);
+  }
+  glDeleteBuffers(FrameRendererPrivate::UploadBufferCount, d->uploadBuffers);
+  glDeleteBuffers(1, &d->parametersBuffer);
+  // names that were never generated are 0, which glDelete*() ignores
+  glDeleteFramebuffers(2, d->depthRangeFBOs);
+  glDeleteFramebuffers(1, &d->splatFBO);
+  glDeleteFramebuffers(1, &d->mapFBO);
+  glDeleteFramebuffers(1, &d->maskFBO);
+  glDeleteRenderbuffers(1, &d->splatDepthBufferHandle);
+  glDeleteTextures(2, d->depthRangeTextureHandles);
+  glDeleteTextures(1, &d->videoTextureHandle);
+  glDeleteTextures(1, &d->depthTextureHandle);
+  glDeleteTextures(1, &d->mapTextureHandle);
+  glDeleteTextures(1, &d->projectionTextureHandle);
+  glDeleteTextures(1, &d->splatTextureHandle);
+  glDeleteTextures(1, &d->maskTextureHandle);
+}
+
+
+void FrameRenderer::initialize(void)
+{
+  Q_D(FrameRenderer);
+
+  initializeOpenGLFunctions();
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  glDepthMask(GL_FALSE);
+
+  const QOpenGLContext *glContext = QOpenGLContext::currentContext();
+  d->hasTextureStorage = glContext->format().version() >= qMakePair(4, 2) || glContext->hasExtension("GL_ARB_texture_storage");
+  if (glContext->format().version() >= qMakePair(3, 3) || glContext->hasExtension("GL_ARB_timer_query"))
+    d->timer.initialize();
+
+  GLint binaryFormatCount = 0;
+  if (glContext->format().version() >= qMakePair(4, 1) || glContext->hasExtension("GL_ARB_get_program_binary"))
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+  d->programCacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+  d->hasProgramBinary = binaryFormatCount > 0 && QDir().mkpath(d->programCacheDirectory);
+  d->programCacheKey = QByteArray(reinterpret_cast<const char*>(glGetString(GL_VENDOR))) + '\n'
+      + QByteArray(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) + '\n'
+      + QByteArray(reinterpret_cast<const char*>(glGetString(GL_VERSION))) + '\n';
+
+  makeQuads();
+  makeVideoTexture();
+
+  glGenTextures(1, &d->depthTextureHandle);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, d->depthTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  allocateTexture(GL_R16UI, DepthWidth, DepthHeight, GL_RED_INTEGER, GL_UNSIGNED_SHORT);
+
+  glGenTextures(1, &d->mapTextureHandle);
+  d->mappingSequence = 0;
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, d->mapTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  allocateTexture(GL_RG16I, ColorWidth, ColorHeight, GL_RG_INTEGER, GL_SHORT);
+
+  glGenBuffers(FrameRendererPrivate::UploadBufferCount, d->uploadBuffers);
+  for (int i = 0; i < FrameRendererPrivate::UploadBufferCount; ++i) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, d->uploadBuffers[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, UploadBufferSize, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  glActiveTexture(GL_TEXTURE3);
+  for (int i = 0; i < FrameRendererPrivate::ImageFBOCount; ++i) {
+    d->imageFBOs[i] = new QOpenGLFramebufferObject(ColorWidth, ColorHeight);
+    glBindTexture(GL_TEXTURE_2D, d->imageFBOs[i]->texture());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  glGenBuffers(1, &d->parametersBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, d->parametersBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(MixParameters), &d->parameters, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, MixParametersBinding, d->parametersBuffer);
+
+  selectShader();
+  makeDepthRangeFilter();
+  setHaloSize(3);
+}
+
+
+bool FrameRenderer::isInitialized(void) const
+{
+  Q_D(const FrameRenderer);
+  return d->mixShaderProgramIsValid();
+}
+
+
+static QByteArray readShaderSource(const QString &fileName)
+{
+  QFile file(fileName);
+  file.open(QIODevice::ReadOnly);
+  return file.readAll();
+}
+
+
+// Compiles the given fragment shader together with the vertex shader,
+// mix.vs.glsl by default, with the defines inserted right after the
+// #version line of the fragment shader. If the driver has linked the
+// same sources before, the program binary it returned then is loaded
+// instead.
+QOpenGLShaderProgram *FrameRenderer::buildProgram(const QString &fragmentShaderFile, const QStringList &defines, const QString &vertexShaderFile)
+{
+  Q_D(FrameRenderer);
+  const QByteArray vertexSource = readShaderSource(vertexShaderFile);
+  QByteArray fragmentSource = readShaderSource(fragmentShaderFile);
+  QByteArray header;
+  foreach (const QString &define, defines)
+    header += "#define " + define.toLatin1() + "\n";
+  const int versionEnd = fragmentSource.indexOf('\n', fragmentSource.indexOf("#version"));
+  fragmentSource.insert(versionEnd + 1, header);
+
+  QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+  program->create();
+  QString binaryFileName;
+  if (d->hasProgramBinary) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(d->programCacheKey);
+    hash.addData(vertexSource);
+    hash.addData(fragmentSource);
+    binaryFileName = d->programCacheDirectory + "/" + QString::fromLatin1(hash.result().toHex()) + ".bin";
+    if (loadProgramBinary(program, binaryFileName))
+      return program;
+    glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+  program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+  // each vertex shader uses either the quad or the splat attributes
+  program->bindAttributeLocation("aVertex", PROGRAM_VERTEX_ATTRIBUTE);
+  program->bindAttributeLocation("aTexCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
+  program->bindAttributeLocation("aDepthPixel", SPLAT_DEPTH_PIXEL_ATTRIBUTE);
+  if (!program->link())
+    qWarning() << "FrameRenderer: cannot link" << vertexShaderFile << fragmentShaderFile << defines << ":" << program->log();
+  else if (d->hasProgramBinary)
+    saveProgramBinary(program, binaryFileName);
+  return program;
+}
+
+
+// The files hold the binary format followed by the binary. A binary
+// the driver rejects, e.g. after an update that didn't change the
+// version string, is removed so that it's written anew.
+bool FrameRenderer::loadProgramBinary(QOpenGLShaderProgram *program, const QString &fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+  const QByteArray data = file.readAll();
+  file.close();
+  GLenum format;
+  if (data.size() <= int(sizeof(format)))
+    return false;
+  memcpy(&format, data.constData(), sizeof(format));
+  glProgramBinary(program->programId(), format, data.constData() + sizeof(format), GLsizei(data.size() - int(sizeof(format))));
+  // link() only takes over the link status of a program without shaders
+  if (!program->link()) {
+    // an unknown format is flagged as an error, too
+    glGetError();
+    qWarning() << "FrameRenderer: discarding stale program binary" << fileName;
+    QFile::remove(fileName);
+    return false;
+  }
+  return true;
+}
+
+
+void FrameRenderer::saveProgramBinary(QOpenGLShaderProgram *program, const QString &fileName)
+{
+  GLint size = 0;
+  glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+  GLenum format;
+  QByteArray data(int(sizeof(format)) + size, Qt::Uninitialized);
+  glGetProgramBinary(program->programId(), size, nullptr, &format, data.data() + sizeof(format));
+  memcpy(data.data(), &format, sizeof(format));
+  QSaveFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    qWarning() << "FrameRenderer: cannot write program binary" << fileName << ":" << file.errorString();
+}
+
+
+// Switches to the variant of the mix shader that the current frame
+// and settings need, building it on first use. A new slider value
+// doesn't recompile anything once both of its variants exist.
+void FrameRenderer::selectShader(void)
+{
+  Q_D(FrameRenderer);
+  const int variant = d->mixVariant();
+  if (variant == d->shaderVariant)
+    return;
+  QOpenGLShaderProgram *program = d->mixPrograms.value(variant);
+  if (program == nullptr) {
+    QStringList defines;
+    if (variant & FrameRendererPrivate::IgnoreDepthVariant)
+      defines << "IGNORE_DEPTH";
+    if (variant & FrameRendererPrivate::VideoIsYuy2Variant)
+      defines << "VIDEO_IS_YUY2";
+    if (variant & FrameRendererPrivate::GammaVariant)
+      defines << "GAMMA";
+    if (variant & FrameRendererPrivate::SaturationVariant)
+      defines << "SATURATION";
+    if (variant & FrameRendererPrivate::ContrastVariant)
+      defines << "CONTRAST";
+    if (variant & FrameRendererPrivate::UpsampledMaskVariant)
+      defines << "UPSAMPLED_MASK";
+    program = buildProgram(":/shaders/mix.fs.glsl", defines);
+    bindParametersBlock(program);
+    d->mixPrograms.insert(variant, program);
+  }
+  d->shaderProgram = program;
+  d->shaderVariant = variant;
+  Q_ASSERT_X(d->mixShaderProgramIsValid(), "FrameRenderer::selectShader()", "error in shader program");
+  d->shaderProgram->bind();
+
+  d->videoTextureLocation = d->shaderProgram->uniformLocation("uVideoTexture");
+  d->shaderProgram->setUniformValue(d->videoTextureLocation, 0);
+
+  d->depthRangeTextureLocation = d->shaderProgram->uniformLocation("uDepthRangeTexture");
+  d->shaderProgram->setUniformValue(d->depthRangeTextureLocation, 7);
+
+  d->mapTextureLocation = d->shaderProgram->uniformLocation("uMapTexture");
+  d->shaderProgram->setUniformValue(d->mapTextureLocation, 2);
+
+  d->imageTextureLocation = d->shaderProgram->uniformLocation("uImageTexture");
+  d->shaderProgram->setUniformValue(d->imageTextureLocation, 3);
+
+  // left out by all but the UPSAMPLED_MASK variants, location -1 is ignored
+  d->shaderProgram->setUniformValue(d->shaderProgram->uniformLocation("uMaskTexture"), 9);
+
+  d->mvMatrixLocation = d->shaderProgram->uniformLocation("uMatrix");
+}
+
+
+void FrameRenderer::bindParametersBlock(QOpenGLShaderProgram *program)
+{
+  // a variant that uses none of the settings has no block
+  const GLuint blockIndex = glGetUniformBlockIndex(program->programId(), "Parameters");
+  if (blockIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(program->programId(), blockIndex, MixParametersBinding);
+}
+
+
+// Applies what changed since the last image: the depth range is
+// filtered again for a new halo, the settings are uploaded into the
+// uniform block with a single call and the shader variant is switched
+// if need be.
+void FrameRenderer::flushChanges(void)
+{
+  Q_D(FrameRenderer);
+  if (d->dirty & FrameRendererPrivate::HaloChanged) {
+    selectDepthRangePrograms();
+    filterDepthRange();
+  }
+  if (d->dirty & FrameRendererPrivate::ScaleChanged)
+    makeMask();
+  if (d->dirty & FrameRendererPrivate::ParametersChanged) {
+    glBindBuffer(GL_UNIFORM_BUFFER, d->parametersBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MixParameters), &d->parameters);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  d->dirty = 0;
+  selectShader();
+}
+
+
+QSurfaceFormat FrameRenderer::surfaceFormat(void)
+{
+  QSurfaceFormat format;
+  format.setRenderableType(QSurfaceFormat::OpenGL);
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setDepthBufferSize(0);
+  format.setStencilBufferSize(0);
+  return format;
+}
+
+
+void FrameRenderer::makeQuads(void)
+{
+  Q_D(FrameRenderer);
+  d->quadBuffer.create();
+  d->quadBuffer.bind();
+  d->quadBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+  d->quadBuffer.allocate(QuadBufferSize);
+  d->quadBuffer.write(int(OffscreenVerticesOffset), Vertices4FBO, int(sizeof(Vertices4FBO)));
+  d->quadBuffer.write(int(TexCoordsOffset), TexCoords, int(sizeof(TexCoords)));
+  d->offscreenQuad.create();
+  d->offscreenQuad.bind();
+  glEnableVertexAttribArray(PROGRAM_VERTEX_ATTRIBUTE);
+  glVertexAttribPointer(PROGRAM_VERTEX_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, bufferOffset(OffscreenVerticesOffset));
+  glEnableVertexAttribArray(PROGRAM_TEXCOORD_ATTRIBUTE);
+  glVertexAttribPointer(PROGRAM_TEXCOORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, bufferOffset(TexCoordsOffset));
+  d->quadBuffer.release();
+}
+
+
+// Binds what the context renders to by default: the window, or the FBO
+// a QOpenGLWidget renders into.
+void FrameRenderer::bindDefaultFramebuffer(void)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, QOpenGLContext::currentContext()->defaultFramebufferObject());
+}
+
+
+void FrameRenderer::allocateTexture(GLenum internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+  Q_D(FrameRenderer);
+  if (d->hasTextureStorage)
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+  else
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(internalFormat), width, height, 0, format, type, nullptr);
+}
+
+
+void FrameRenderer::makeVideoTexture(void)
+{
+  Q_D(FrameRenderer);
+  // immutable storage can't be resized, so a new color format needs a new texture
+  if (d->videoTextureHandle != 0)
+    glDeleteTextures(1, &d->videoTextureHandle);
+  glGenTextures(1, &d->videoTextureHandle);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, d->videoTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (d->colorFormat == ColorFormatYuy2) {
+    // one RGBA texel per macropixel, converted in the fragment shader
+    allocateTexture(GL_RGBA8, ColorWidth / 2, ColorHeight, GL_RGBA, GL_UNSIGNED_BYTE);
+  }
+  else {
+    allocateTexture(GL_RGBA8, ColorWidth, ColorHeight, GL_BGRA, GL_UNSIGNED_BYTE);
+  }
+}
+
+
+void FrameRenderer::renderImage(void)
+{
+  Q_D(FrameRenderer);
+  flushChanges();
+  // the next FBO that neither holds the previous image nor is presented
+  int index = d->lastImageFBOIndex;
+  do {
+    index = (index + 1) % FrameRendererPrivate::ImageFBOCount;
+  } while (d->imageFBOs[index]->texture() == d->presentedTexture);
+  QOpenGLFramebufferObject *current = d->imageFBOs[index];
+  QOpenGLFramebufferObject *previous = d->lastImageFBO();
+  // the passes since process() may have used the texture units
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, d->videoTextureHandle);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, d->mapTextureHandle);
+  glActiveTexture(GL_TEXTURE7);
+  glBindTexture(GL_TEXTURE_2D, d->depthRangeTextureHandles[1]);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D, previous->texture());
+  if (d->shaderVariant & FrameRendererPrivate::UpsampledMaskVariant)
+    renderMask();
+  d->timer.begin(MixStage);
+  current->bind();
+  d->shaderProgram->bind();
+  d->offscreenQuad.bind();
+  d->shaderProgram->setUniformValue(d->mvMatrixLocation, QMatrix4x4());
+  glViewport(0, 0, current->width(), current->height());
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  current->release();
+  d->timer.end();
+  d->lastImageFBOIndex = index;
+}
+
+
+QVector<GpuTimer::Timing> FrameRenderer::timings(void) const
+{
+  Q_D(const FrameRenderer);
+  if (!d->timer.isInitialized())
+    return QVector<GpuTimer::Timing>();
+  return d->timer.timings();
+}
+
+
+QImage FrameRenderer::image(void)
+{
+  Q_D(FrameRenderer);
+  // the FBO holds the first row of the color frame at the bottom
+  return d->lastImageFBO()->toImage().mirrored();
+}
+
+
+GLuint FrameRenderer::imageTexture(void) const
+{
+  Q_D(const FrameRenderer);
+  return d->lastImageFBO()->texture();
+}
+
+
+void FrameRenderer::setPresentedTexture(GLuint texture)
+{
+  Q_D(FrameRenderer);
+  d->presentedTexture = texture;
+}
+
+
+void FrameRenderer::process(const FrameSet &frameSet)
+{
+  Q_D(FrameRenderer);
+
+  Q_ASSERT_X(!frameSet.isNull(), "FrameRenderer::process()", "frame set must not be null");
+
+  d->timer.collect();
+
+  const UINT16 *pDepth = frameSet.depth->buffer;
+  const uchar *pColor = reinterpret_cast<const uchar*>(frameSet.color->buffer);
+  const ColorFormat colorFormat = frameSet.color->format;
+
+  if (colorFormat != d->colorFormat) {
+    d->colorFormat = colorFormat;
+    selectShader();
+    makeVideoTexture();
+  }
+
+  // keep the previous mapping if there's none for this frame; if the
+  // texture holds the one this one was derived from, only the rects
+  // that changed are uploaded
+  QVector<QRect> mappingRects;
+  if (!d->forwardMapping && !frameSet.mapping.isNull()) {
+    if (d->mappingSequence != 0 && frameSet.mapping->sequence == d->mappingSequence + 1)
+      mappingRects = frameSet.mapping->dirtyRects;
+    else
+      mappingRects.append(QRect(0, 0, ColorWidth, ColorHeight));
+    d->mappingSequence = frameSet.mapping->sequence;
+  }
+
+  // the GPU has usually long finished copying from the buffer by now
+  GLsync &fence = d->uploadFences[d->uploadIndex];
+  if (fence != nullptr) {
+    if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UploadFenceTimeout) == GL_TIMEOUT_EXPIRED)
+      qWarning() << "FrameRenderer: timed out waiting for an upload buffer";
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, d->uploadBuffers[d->uploadIndex]);
+  uchar *staging = reinterpret_cast<uchar*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, UploadBufferSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+  Q_ASSERT_X(staging != nullptr, "FrameRenderer::process()", "glMapBufferRange() failed");
+  memcpy(staging + ColorUploadOffset, pColor, size_t(frameSet.color->byteSize()));
+  memcpy(staging + DepthUploadOffset, pDepth, DepthSize * sizeof(UINT16));
+  // the rects are staged one after the other without gaps
+  DSP *stagedMapping = reinterpret_cast<DSP*>(staging + MappingUploadOffset);
+  foreach (const QRect &rect, mappingRects) {
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+      memcpy(stagedMapping, frameSet.mapping->buffer + rect.x() + y * ColorWidth, rect.width() * sizeof(DSP));
+      stagedMapping += rect.width();
+    }
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, d->videoTextureHandle);
+  d->timer.begin(ColorUploadStage);
+  if (colorFormat == ColorFormatYuy2) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ColorWidth / 2, ColorHeight, GL_RGBA, GL_UNSIGNED_BYTE, bufferOffset(ColorUploadOffset));
+  }
+  else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ColorWidth, ColorHeight, GL_BGRA, GL_UNSIGNED_BYTE, bufferOffset(ColorUploadOffset));
+  }
+  d->timer.end();
+  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "FrameRenderer::process()", "glTexSubImage2D() failed");
+
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, d->depthTextureHandle);
+  d->timer.begin(DepthUploadStage);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DepthWidth, DepthHeight, GL_RED_INTEGER, GL_UNSIGNED_SHORT, bufferOffset(DepthUploadOffset));
+  d->timer.end();
+  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "FrameRenderer::process()", "glTexSubImage2D() failed");
+
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, d->mapTextureHandle);
+  qptrdiff mappingOffset = MappingUploadOffset;
+  if (!mappingRects.isEmpty())
+    d->timer.begin(MappingUploadStage);
+  foreach (const QRect &rect, mappingRects) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), rect.width(), rect.height(), GL_RG_INTEGER, GL_SHORT, bufferOffset(mappingOffset));
+    mappingOffset += rect.width() * rect.height() * sizeof(DSP);
+  }
+  d->timer.end();
+  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "FrameRenderer::process()", "glTexSubImage2D() failed");
+
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  d->uploadIndex = (d->uploadIndex + 1) % FrameRendererPrivate::UploadBufferCount;
+
+  // the new depth is filtered with a new halo right away
+  if (d->dirty & FrameRendererPrivate::HaloChanged) {
+    selectDepthRangePrograms();
+    d->dirty &= ~FrameRendererPrivate::HaloChanged;
+  }
+  filterDepthRange();
+  if (d->forwardMapping)
+    splatMapping();
+
+  ++d->frameCount;
+  selectShader();
+}
+
+
+void FrameRenderer::setForwardMapping(bool enabled)
+{
+  Q_D(FrameRenderer);
+  d->forwardMapping = enabled;
+}
+
+
+void FrameRenderer::makeForwardMapping(void)
+{
+  Q_D(FrameRenderer);
+  d->splatProgram = buildProgram(":/shaders/splat.fs.glsl", QStringList(), ":/shaders/splat.vs.glsl");
+  Q_ASSERT_X(d->splatProgram->isLinked(), "FrameRenderer::makeForwardMapping()", "error in splat shader program");
+  d->splatProgram->bind();
+  d->splatProgram->setUniformValue("uDepthTexture", 1);
+  d->splatProgram->setUniformValue("uProjectionTexture", 5);
+  d->projectionOffsetLocation = d->splatProgram->uniformLocation("uProjectionOffset");
+
+  d->dilateProgram = buildProgram(":/shaders/dilate.fs.glsl");
+  Q_ASSERT_X(d->dilateProgram->isLinked(), "FrameRenderer::makeForwardMapping()", "error in dilate shader program");
+  d->dilateProgram->bind();
+  d->dilateProgram->setUniformValue("uSplatTexture", 6);
+  d->dilateProgram->setUniformValue("uMatrix", QMatrix4x4());
+
+  // the points to splat are just the depth pixel coordinates
+  QVector<QVector2D> depthPixels;
+  depthPixels.reserve(DepthSize);
+  for (int y = 0; y < DepthHeight; ++y)
+    for (int x = 0; x < DepthWidth; ++x)
+      depthPixels.append(QVector2D(float(x), float(y)));
+  d->splatPoints.create();
+  d->splatPoints.bind();
+  d->depthPixelBuffer.create();
+  d->depthPixelBuffer.bind();
+  d->depthPixelBuffer.allocate(depthPixels.constData(), depthPixels.count() * int(sizeof(QVector2D)));
+  d->splatProgram->enableAttributeArray(SPLAT_DEPTH_PIXEL_ATTRIBUTE);
+  d->splatProgram->setAttributeBuffer(SPLAT_DEPTH_PIXEL_ATTRIBUTE, GL_FLOAT, 0, 2);
+  d->depthPixelBuffer.release();
+  d->offscreenQuad.bind();
+
+  glGenTextures(1, &d->projectionTextureHandle);
+  glActiveTexture(GL_TEXTURE5);
+  glBindTexture(GL_TEXTURE_2D, d->projectionTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, DepthWidth, DepthHeight, 0, GL_RGB, GL_FLOAT, nullptr);
+
+  glGenTextures(1, &d->splatTextureHandle);
+  glActiveTexture(GL_TEXTURE6);
+  glBindTexture(GL_TEXTURE_2D, d->splatTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, ColorWidth, ColorHeight, 0, GL_RG, GL_FLOAT, nullptr);
+  glGenRenderbuffers(1, &d->splatDepthBufferHandle);
+  glBindRenderbuffer(GL_RENDERBUFFER, d->splatDepthBufferHandle);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ColorWidth, ColorHeight);
+  glGenFramebuffers(1, &d->splatFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, d->splatFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->splatTextureHandle, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, d->splatDepthBufferHandle);
+  Q_ASSERT_X(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "FrameRenderer::makeForwardMapping()", "splat framebuffer incomplete");
+
+  glGenFramebuffers(1, &d->mapFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, d->mapFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->mapTextureHandle, 0);
+  Q_ASSERT_X(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "FrameRenderer::makeForwardMapping()", "map framebuffer incomplete");
+
+  bindDefaultFramebuffer();
+  d->shaderProgram->bind();
+}
+
+
+void FrameRenderer::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(FrameRenderer);
+  if (!d->forwardMapping)
+    return;
+  if (d->splatProgram == nullptr)
+    makeForwardMapping();
+  QVector<float> coeffU(DepthSize);
+  QVector<float> coeffV(DepthSize);
+  QVector<float> coeffW(DepthSize);
+  calibration.colorProjectionTable(coeffU.data(), coeffV.data(), coeffW.data());
+  QVector<float> table;
+  table.reserve(3 * DepthSize);
+  for (int i = 0; i < DepthSize; ++i)
+    table << coeffU.at(i) << coeffV.at(i) << coeffW.at(i);
+  glActiveTexture(GL_TEXTURE5);
+  glBindTexture(GL_TEXTURE_2D, d->projectionTextureHandle);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, DepthWidth, DepthHeight, 0, GL_RGB, GL_FLOAT, table.constData());
+
+  // the points must cover the most stretched depth pixel (see CoordinateMapper)
+  float maxExtent = 1.f;
+  for (int i = 1; i < DepthSize; ++i) {
+    if (i % DepthWidth != 0)
+      maxExtent = qMax(maxExtent, std::fabs(coeffU.at(i) / coeffW.at(i) - coeffU.at(i - 1) / coeffW.at(i - 1)));
+    if (i >= DepthWidth)
+      maxExtent = qMax(maxExtent, std::fabs(coeffV.at(i) / coeffW.at(i) - coeffV.at(i - DepthWidth) / coeffW.at(i - DepthWidth)));
+  }
+  d->splatPointSize = std::ceil(maxExtent);
+  d->splatProgram->bind();
+  d->splatProgram->setUniformValue(d->projectionOffsetLocation, QVector3D(
+                                     float(calibration.colorProjection[0][3]),
+                                     float(calibration.colorProjection[1][3]),
+                                     float(calibration.colorProjection[2][3])));
+  d->shaderProgram->bind();
+  d->hasCalibration = true;
+  qDebug() << "FrameRenderer: splatting depth pixels as" << d->splatPointSize << "px points";
+}
+
+
+void FrameRenderer::makeDepthRangeFilter(void)
+{
+  Q_D(FrameRenderer);
+  glGenTextures(2, d->depthRangeTextureHandles);
+  glGenFramebuffers(2, d->depthRangeFBOs);
+  for (int i = 0; i < 2; ++i) {
+    glActiveTexture(i == 0 ? GL_TEXTURE8 : GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, d->depthRangeTextureHandles[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    allocateTexture(GL_RG16UI, DepthWidth, DepthHeight, GL_RG_INTEGER, GL_UNSIGNED_SHORT);
+    glBindFramebuffer(GL_FRAMEBUFFER, d->depthRangeFBOs[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->depthRangeTextureHandles[i], 0);
+    Q_ASSERT_X(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "FrameRenderer::makeDepthRangeFilter()", "depth range framebuffer incomplete");
+  }
+
+  bindDefaultFramebuffer();
+  d->shaderProgram->bind();
+}
+
+
+// Returns the program for one pass of the depth range filter, building
+// it on first use. The horizontal pass reads the depth texture, the
+// vertical one the result of the horizontal pass.
+QOpenGLShaderProgram *FrameRenderer::depthRangeProgram(int radius, bool horizontal)
+{
+  Q_D(FrameRenderer);
+  const int key = 2 * radius + (horizontal ? 1 : 0);
+  QOpenGLShaderProgram *program = d->depthRangePrograms.value(key);
+  if (program == nullptr) {
+    QStringList defines;
+    defines << QString("RADIUS %1").arg(radius);
+    if (horizontal)
+      defines << "HORIZONTAL";
+    program = buildProgram(":/shaders/depthrange.fs.glsl", defines);
+    Q_ASSERT_X(program->isLinked(), "FrameRenderer::depthRangeProgram()", "error in depth range shader program");
+    program->bind();
+    program->setUniformValue("uMatrix", QMatrix4x4());
+    program->setUniformValue("uSource", horizontal ? 1 : 8);
+    d->depthRangePrograms.insert(key, program);
+    d->shaderProgram->bind();
+  }
+  return program;
+}
+
+
+// Finds the nearest and farthest depth within the halo around each
+// depth pixel, so that the mix shader needs a single fetch instead of
+// one per halo pixel. Being separable, the cost grows with the halo's
+// width plus height, at 512x424 instead of 1920x1080 fragments.
+void FrameRenderer::filterDepthRange(void)
+{
+  Q_D(FrameRenderer);
+  d->timer.begin(DepthRangeStage);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, d->depthTextureHandle);
+  glViewport(0, 0, DepthWidth, DepthHeight);
+  d->offscreenQuad.bind();
+  d->horizontalDepthRangeProgram->bind();
+  glBindFramebuffer(GL_FRAMEBUFFER, d->depthRangeFBOs[0]);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  d->verticalDepthRangeProgram->bind();
+  glBindFramebuffer(GL_FRAMEBUFFER, d->depthRangeFBOs[1]);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  bindDefaultFramebuffer();
+  d->shaderProgram->bind();
+  d->timer.end();
+  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "FrameRenderer::filterDepthRange()", "filtering failed");
+}
+
+
+// Renders the map texture from the depth texture without a mapping
+// computed on the CPU: every depth pixel is drawn as a point where it
+// lands in the color frame, the depth test keeping the nearest one.
+// Until the calibration is known the map stays invalid.
+void FrameRenderer::splatMapping(void)
+{
+  Q_D(FrameRenderer);
+  if (d->splatProgram == nullptr)
+    makeForwardMapping();
+
+  d->timer.begin(SplatStage);
+  glBindFramebuffer(GL_FRAMEBUFFER, d->splatFBO);
+  glViewport(0, 0, ColorWidth, ColorHeight);
+  glClearColor(-1.f, -1.f, 0.f, 0.f);
+  glClearDepth(1.0);
+  glDepthMask(GL_TRUE);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  if (d->hasCalibration) {
+    glEnable(GL_DEPTH_TEST);
+    glPointSize(d->splatPointSize);
+    d->splatProgram->bind();
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, d->projectionTextureHandle);
+    d->splatPoints.bind();
+    glDrawArrays(GL_POINTS, 0, DepthSize);
+    glDisable(GL_DEPTH_TEST);
+  }
+  glDepthMask(GL_FALSE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, d->mapFBO);
+  d->dilateProgram->bind();
+  glActiveTexture(GL_TEXTURE6);
+  glBindTexture(GL_TEXTURE_2D, d->splatTextureHandle);
+  d->offscreenQuad.bind();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  bindDefaultFramebuffer();
+  d->shaderProgram->bind();
+  d->timer.end();
+  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "FrameRenderer::splatMapping()", "splatting failed");
+}
+
+
+void FrameRenderer::setContrast(float contrast)
+{
+  Q_D(FrameRenderer);
+  d->parameters.contrast = contrast;
+  d->dirty |= FrameRendererPrivate::ParametersChanged;
+}
+
+
+void FrameRenderer::setSaturation(float saturation)
+{
+  Q_D(FrameRenderer);
+  d->parameters.saturation = saturation;
+  d->dirty |= FrameRendererPrivate::ParametersChanged;
+}
+
+
+void FrameRenderer::setGamma(float gamma)
+{
+  Q_D(FrameRenderer);
+  d->parameters.gamma = gamma;
+  d->dirty |= FrameRendererPrivate::ParametersChanged;
+}
+
+
+void FrameRenderer::setNearThreshold(float nearThreshold)
+{
+  Q_D(FrameRenderer);
+  qDebug() << "FrameRenderer::setNearThreshold(" << nearThreshold << ")";
+  d->parameters.nearThreshold = nearThreshold;
+  d->dirty |= FrameRendererPrivate::ParametersChanged;
+}
+
+
+void FrameRenderer::setFarThreshold(float farThreshold)
+{
+  Q_D(FrameRenderer);
+  qDebug() << "FrameRenderer::setFarThreshold(" << farThreshold << ")";
+  d->parameters.farThreshold = farThreshold;
+  d->dirty |= FrameRendererPrivate::ParametersChanged;
+}
+
+
+void FrameRenderer::setProcessingScale(int divisor)
+{
+  Q_D(FrameRenderer);
+  Q_ASSERT_X(divisor == 1 || divisor == 2 || divisor == 4, "FrameRenderer::setProcessingScale()", "divisor must be 1, 2 or 4");
+  if (divisor == d->processingScale)
+    return;
+  d->processingScale = divisor;
+  d->dirty |= FrameRendererPrivate::ScaleChanged;
+}
+
+
+// (Re)allocates the mask for the current processing scale; immutable
+// storage can't be resized, so a new scale needs a new texture.
+void FrameRenderer::makeMask(void)
+{
+  Q_D(FrameRenderer);
+  if (d->maskTextureHandle != 0) {
+    glDeleteFramebuffers(1, &d->maskFBO);
+    glDeleteTextures(1, &d->maskTextureHandle);
+    d->maskFBO = 0;
+    d->maskTextureHandle = 0;
+  }
+  if (d->processingScale == 1)
+    return;
+
+  if (d->maskProgram == nullptr) {
+    d->maskProgram = buildProgram(":/shaders/mix.fs.glsl", QStringList() << "MASK_PASS");
+    Q_ASSERT_X(d->maskProgram->isLinked(), "FrameRenderer::makeMask()", "error in mask shader program");
+    bindParametersBlock(d->maskProgram);
+    d->maskProgram->bind();
+    d->maskProgram->setUniformValue("uMatrix", QMatrix4x4());
+    d->maskProgram->setUniformValue("uDepthRangeTexture", 7);
+    d->maskProgram->setUniformValue("uMapTexture", 2);
+  }
+
+  glGenTextures(1, &d->maskTextureHandle);
+  glActiveTexture(GL_TEXTURE9);
+  glBindTexture(GL_TEXTURE_2D, d->maskTextureHandle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  allocateTexture(GL_R8, ColorWidth / d->processingScale, ColorHeight / d->processingScale, GL_RED, GL_UNSIGNED_BYTE);
+  glGenFramebuffers(1, &d->maskFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, d->maskFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->maskTextureHandle, 0);
+  Q_ASSERT_X(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "FrameRenderer::makeMask()", "mask framebuffer incomplete");
+
+  bindDefaultFramebuffer();
+  d->shaderProgram->bind();
+}
+
+
+// Decides which pixels to keep at the processing scale. The map and
+// depth range textures must be bound to their units already.
+void FrameRenderer::renderMask(void)
+{
+  Q_D(FrameRenderer);
+  d->timer.begin(MaskStage);
+  glBindFramebuffer(GL_FRAMEBUFFER, d->maskFBO);
+  glViewport(0, 0, ColorWidth / d->processingScale, ColorHeight / d->processingScale);
+  d->maskProgram->bind();
+  d->offscreenQuad.bind();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  bindDefaultFramebuffer();
+  glActiveTexture(GL_TEXTURE9);
+  glBindTexture(GL_TEXTURE_2D, d->maskTextureHandle);
+  d->timer.end();
+}
+
+
+void FrameRenderer::setHaloSize(int s)
+{
+  Q_D(FrameRenderer);
+  // twice as wide as high, like the depth pixels are as seen from the color camera
+  d->haloRadiusX = (s + s / 2) / 2;
+  d->haloRadiusY = s / 2;
+  d->dirty |= FrameRendererPrivate::HaloChanged;
+}
+
+
+void FrameRenderer::selectDepthRangePrograms(void)
+{
+  Q_D(FrameRenderer);
+  d->horizontalDepthRangeProgram = depthRangeProgram(d->haloRadiusX, true);
+  d->verticalDepthRangeProgram = depthRangeProgram(d->haloRadiusY, false);
+}
@@ -0,0 +1,128 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMERENDERER_H_
+#define __FRAMERENDERER_H_
+
+#include <QScopedPointer>
+#include <QOpenGLExtraFunctions>
+#include <QMatrix4x4>
+#include <QImage>
+#include <QStringList>
+#include <QSurfaceFormat>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+#include "removalengine.h"
+#include "gputimer.h"
+
+class FrameRendererPrivate;
+class QOpenGLShaderProgram;
+
+// The RemovalEngine on the GPU: uploads the frame sets, filters
+// the depth and renders the color pixels whose depth lies between the
+// thresholds, filling the others in from the previous frame. It owns
+// no window, so all methods expect the context that was current when
+// initialize() was called to be current again.
+class FrameRenderer : public RemovalEngine, protected QOpenGLExtraFunctions
+{
+public:
+  // the stages whose GPU time is measured, see timings()
+  enum Stage {
+    ColorUploadStage = 0,
+    DepthUploadStage,
+    MappingUploadStage,
+    DepthRangeStage,
+    SplatStage,
+    MaskStage,
+    MixStage,
+    StageCount
+  };
+
+  FrameRenderer(void);
+  // deletes the GL objects, so the context must be current
+  ~FrameRenderer();
+
+  // the format of the contexts initialize() may be called in
+  static QSurfaceFormat surfaceFormat(void);
+
+  void initialize(void);
+  bool isInitialized(void) const;
+
+  virtual void process(const FrameSet&);
+  // renders the current frame set into an offscreen image
+  virtual void renderImage(void);
+  // reads the last image back
+  virtual QImage image(void);
+  // the texture holding the last image
+  GLuint imageTexture(void) const;
+  // keeps renderImage() from rendering into a texture returned by
+  // imageTexture() while another context draws it, 0 for none
+  void setPresentedTexture(GLuint texture);
+
+  // projects the depth pixels into the color frame on the GPU instead
+  // of using the mapping that comes with the frame sets
+  void setForwardMapping(bool enabled);
+  void setCalibration(const SensorCalibration&);
+  // decides which pixels to keep for one in divisor x divisor color
+  // pixels only and blends the color in through the upsampled mask;
+  // 1 (the default) decides for every pixel
+  void setProcessingScale(int divisor);
+
+  // the median and 99th percentile GPU time of each stage over the
+  // last few seconds, a few frames behind; empty if the driver can't
+  // measure them
+  QVector<GpuTimer::Timing> timings(void) const;
+
+  virtual void setContrast(float);
+  virtual void setSaturation(float);
+  virtual void setGamma(float);
+  virtual void setNearThreshold(float);
+  virtual void setFarThreshold(float);
+  virtual void setHaloSize(int);
+
+private:
+  QScopedPointer<FrameRendererPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(FrameRenderer)
+  Q_DISABLE_COPY(FrameRenderer)
+
+  QOpenGLShaderProgram *buildProgram(const QString &fragmentShaderFile, const QStringList &defines = QStringList(), const QString &vertexShaderFile = ":/shaders/mix.vs.glsl");
+  bool loadProgramBinary(QOpenGLShaderProgram*, const QString &fileName);
+  void saveProgramBinary(QOpenGLShaderProgram*, const QString &fileName);
+  void selectShader(void);
+  void bindParametersBlock(QOpenGLShaderProgram*);
+  void flushChanges(void);
+  void makeQuads(void);
+  void bindDefaultFramebuffer(void);
+  void makeVideoTexture(void);
+  void allocateTexture(GLenum internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type);
+
+  void makeForwardMapping(void);
+  void splatMapping(void);
+
+  void makeDepthRangeFilter(void);
+  QOpenGLShaderProgram *depthRangeProgram(int radius, bool horizontal);
+  void selectDepthRangePrograms(void);
+  void filterDepthRange(void);
+
+  void makeMask(void);
+  void renderMask(void);
+};
+
+#endif // __FRAMERENDERER_H_
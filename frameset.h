@@ -0,0 +1,194 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMESET_H_
+#define __FRAMESET_H_
+
+#include <QRgb>
+#include <QRect>
+#include <QVector>
+
+#include "kinectcompat.h"
+#include "globals.h"
+#include "util.h"
+#include "framepool.h"
+
+
+// The acquire methods of a FrameSource fill the caller-provided buffer
+// and the remaining fields of these descriptors.
+
+struct DepthFrameData {
+  DepthFrameData(void)
+    : timestamp(0)
+    , buffer(nullptr)
+    , width(0)
+    , height(0)
+    , minReliableDistance(0)
+    , maxReliableDistance(USHRT_MAX)
+  { /* ... */ }
+  INT64 timestamp;
+  UINT16 *buffer;
+  int width;
+  int height;
+  int minReliableDistance;
+  int maxReliableDistance;
+};
+
+
+enum ColorFormat {
+  ColorFormatBgra = 0,
+  ColorFormatYuy2
+};
+
+
+// In YUY2 format every element of the buffer holds one macropixel,
+// i.e. two horizontally adjacent pixels (Y0 U Y1 V), so only the
+// first half of the buffer is used.
+struct ColorFrameData {
+  ColorFrameData(void)
+    : timestamp(0)
+    , buffer(nullptr)
+    , width(0)
+    , height(0)
+    , format(ColorFormatBgra)
+  { /* ... */ }
+  int byteSize(void) const {
+    return width * height * (format == ColorFormatYuy2 ? 2 : 4);
+  }
+  INT64 timestamp;
+  QRgb *buffer;
+  int width;
+  int height;
+  ColorFormat format;
+};
+
+
+struct IRFrameData {
+  IRFrameData(void)
+    : timestamp(0)
+    , buffer(nullptr)
+    , width(0)
+    , height(0)
+  { /* ... */ }
+  INT64 timestamp;
+  UINT16 *buffer;
+  int width;
+  int height;
+};
+
+
+// Depth space point rounded to the nearest depth pixel, -1 if the
+// color pixel has no depth. Half the size of a DepthSpacePoint and
+// ready to be uploaded as an RG16I texture.
+struct DSP {
+  DSP(void)
+    : x(0)
+    , y(0)
+  { /* ... */ }
+  INT16 x;
+  INT16 y;
+};
+
+
+// Where every pixel of a color frame lies in its depth frame.
+// Mappings are numbered consecutively; dirtyRects lists the color
+// pixels that differ from the mapping numbered one less, so that a
+// consumer who has seen that one only needs to update those.
+struct MappingFrameData {
+  MappingFrameData(void)
+    : timestamp(0)
+    , buffer(nullptr)
+    , width(0)
+    , height(0)
+    , sequence(0)
+  { /* ... */ }
+  INT64 timestamp;
+  DSP *buffer;
+  int width;
+  int height;
+  quint64 sequence;
+  QVector<QRect> dirtyRects;
+};
+
+
+typedef FrameRef<DepthFrameData> DepthFrameRef;
+typedef FrameRef<ColorFrameData> ColorFrameRef;
+typedef FrameRef<IRFrameData> IRFrameRef;
+typedef FrameRef<MappingFrameData> MappingFrameRef;
+
+
+// the frame sets held at the same time by the synchronizer, the
+// capture thread's ring, the render thread and the widgets; fewer of
+// them hold a mapping
+static const int FrameSetsInFlight = 12;
+static const int MappingsInFlight = 8;
+// the frame sets the session recorder queues while it writes, half a
+// second of frames
+static const int RecorderQueueSize = 15;
+
+
+// process-wide, so that frames may outlive whoever acquired them, and
+// large enough that recording doesn't make them grow
+inline FramePool<DepthFrameData> &depthFramePool(void)
+{
+  static FramePool<DepthFrameData> pool(DepthSize, FrameSetsInFlight + RecorderQueueSize);
+  return pool;
+}
+
+
+inline FramePool<ColorFrameData> &colorFramePool(void)
+{
+  static FramePool<ColorFrameData> pool(ColorSize, FrameSetsInFlight + RecorderQueueSize);
+  return pool;
+}
+
+
+inline FramePool<IRFrameData> &irFramePool(void)
+{
+  static FramePool<IRFrameData> pool(IRSize, FrameSetsInFlight + RecorderQueueSize);
+  return pool;
+}
+
+
+inline FramePool<MappingFrameData> &mappingFramePool(void)
+{
+  static FramePool<MappingFrameData> pool(ColorSize, MappingsInFlight + RecorderQueueSize);
+  return pool;
+}
+
+
+// Matching color, depth and infrared frames plus the mapping of the
+// color frame into the depth frame.
+struct FrameSet {
+  bool isNull(void) const {
+    return depth.isNull() || color.isNull() || ir.isNull();
+  }
+  void reset(void) {
+    depth.reset();
+    color.reset();
+    ir.reset();
+    mapping.reset();
+  }
+  DepthFrameRef depth;
+  ColorFrameRef color;
+  IRFrameRef ir;
+  MappingFrameRef mapping;
+};
+
+#endif // __FRAMESET_H_
@@ -0,0 +1,39 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "framesource.h"
+#include "replayframesource.h"
+#ifdef _WIN32
+#include "kinectframesource.h"
+#endif
+
+#include <QDebug>
+
+
+FrameSource *FrameSource::create(const QString &replayFileName, bool fullSpeed)
+{
+  if (!replayFileName.isEmpty())
+    return new ReplayFrameSource(replayFileName, fullSpeed);
+#ifdef _WIN32
+  return new KinectFrameSource;
+#else
+  qWarning() << "No Kinect support in this build. Use --replay to play back a recorded session.";
+  return nullptr;
+#endif
+}
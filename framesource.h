@@ -0,0 +1,71 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMESOURCE_H_
+#define __FRAMESOURCE_H_
+
+#include <QString>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+
+// A FrameSource delivers color, depth and infrared frames plus the
+// mapping from color to depth space. The acquire*() methods copy the
+// latest frame of a stream into the buffer of the given descriptor and
+// return false if the stream has nothing new to offer.
+class FrameSource
+{
+public:
+  virtual ~FrameSource() { /* ... */ }
+
+  virtual bool open(void) = 0;
+  virtual void close(void) = 0;
+
+  // true if frames arrive at sensor rate, false if the source
+  // delivers them as fast as they're being asked for
+  virtual bool isRealTime(void) const = 0;
+
+  // blocks until at least one stream has a new frame or timeoutMs
+  // elapsed; returns false right away if the source can't deliver at all
+  virtual bool waitForFrames(int timeoutMs) = 0;
+
+  // a hint which format acquireColorFrame() should deliver; sources
+  // that can't comply deliver BGRA or whatever has been recorded
+  virtual void setColorFormat(ColorFormat) { /* ... */ }
+
+  virtual bool acquireDepthFrame(DepthFrameData&) = 0;
+  virtual bool acquireColorFrame(ColorFrameData&) = 0;
+  virtual bool acquireIRFrame(IRFrameData&) = 0;
+
+  // fills ColorSize depth space points for the given depth frame
+  virtual bool mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DepthSpacePoint *depthSpacePoints) = 0;
+  // the same as DSPs, for sources that don't have to go through the
+  // depth space points; false if the source can't, so that the points
+  // have to be converted (see depthSpacePointsToDsp())
+  virtual bool mapColorFrameToDsp(const UINT16 *depthBuffer, DSP *dsp) { Q_UNUSED(depthBuffer); Q_UNUSED(dsp); return false; }
+
+  // the geometry to map natively with (see CoordinateMapper); false if
+  // there's none (yet), so that the mapping has to be asked for
+  virtual bool calibration(SensorCalibration&) { return false; }
+
+  static FrameSource *create(const QString &replayFileName = QString(), bool fullSpeed = false);
+};
+
+#endif // __FRAMESOURCE_H_
@@ -0,0 +1,232 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "framesynchronizer.h"
+
+#include <algorithm>
+
+#include <QAtomicInt>
+
+static const int HistorySize = 4;
+
+
+template <typename FrameData>
+class StreamHistory {
+public:
+  StreamHistory(FramePool<FrameData> &pool)
+    : pool(pool)
+    , count(0)
+  { /* ... */ }
+
+  // the frame to acquire the next frame into
+  FrameData &next(void)
+  {
+    if (spare.isNull())
+      spare = pool.acquire();
+    return spare.writable();
+  }
+
+  // returns false if the oldest frame had to make room
+  bool commit(void)
+  {
+    const bool full = count == HistorySize;
+    if (full)
+      dropFront(1);
+    entries[count++] = std::move(spare);
+    return !full;
+  }
+
+  void dropFront(int n)
+  {
+    for (int i = 0; i < n; ++i)
+      entries[i].reset();
+    std::rotate(entries, entries + n, entries + HistorySize);
+    count -= n;
+  }
+
+  const FrameData &at(int i) const
+  {
+    return *entries[i];
+  }
+
+  // Returns the index of the frame closest to timestamp within tolerance
+  // or -1. Frames too old to match this or any later timestamp are
+  // dropped. missed is set if the partner of timestamp can't arrive anymore.
+  int findMatch(INT64 timestamp, INT64 tolerance, bool &missed)
+  {
+    int stale = 0;
+    while (stale < count && at(stale).timestamp < timestamp - tolerance)
+      ++stale;
+    if (stale > 0)
+      dropFront(stale);
+    missed = count > 0 && at(0).timestamp > timestamp + tolerance;
+    int best = -1;
+    for (int i = 0; i < count && at(i).timestamp <= timestamp + tolerance; ++i)
+      if (best < 0 || qAbs(at(i).timestamp - timestamp) < qAbs(at(best).timestamp - timestamp))
+        best = i;
+    return best;
+  }
+
+  FrameRef<FrameData> take(int index)
+  {
+    dropFront(index);
+    FrameRef<FrameData> frame = std::move(entries[0]);
+    dropFront(1);
+    return frame;
+  }
+
+  FramePool<FrameData> &pool;
+  FrameRef<FrameData> spare;
+  FrameRef<FrameData> entries[HistorySize];
+  int count;
+};
+
+
+class FrameSynchronizerPrivate {
+public:
+  FrameSynchronizerPrivate(INT64 skewTolerance)
+    : skewTolerance(skewTolerance)
+    , depth(depthFramePool())
+    , color(colorFramePool())
+    , ir(irFramePool())
+    , colorIndex(-1)
+    , irIndex(-1)
+    , discardedFrameSets(0)
+  { /* ... */ }
+
+  INT64 skewTolerance;
+  StreamHistory<DepthFrameData> depth;
+  StreamHistory<ColorFrameData> color;
+  StreamHistory<IRFrameData> ir;
+  int colorIndex;
+  int irIndex;
+  QAtomicInt discardedFrameSets;
+};
+
+
+FrameSynchronizer::FrameSynchronizer(INT64 skewTolerance)
+  : d_ptr(new FrameSynchronizerPrivate(skewTolerance))
+{
+  // ...
+}
+
+
+FrameSynchronizer::~FrameSynchronizer()
+{
+  // ...
+}
+
+
+void FrameSynchronizer::setSkewTolerance(INT64 skewTolerance)
+{
+  Q_D(FrameSynchronizer);
+  d->skewTolerance = skewTolerance;
+}
+
+
+INT64 FrameSynchronizer::skewTolerance(void) const
+{
+  Q_D(const FrameSynchronizer);
+  return d->skewTolerance;
+}
+
+
+DepthFrameData &FrameSynchronizer::depthSlot(void)
+{
+  Q_D(FrameSynchronizer);
+  return d->depth.next();
+}
+
+
+ColorFrameData &FrameSynchronizer::colorSlot(void)
+{
+  Q_D(FrameSynchronizer);
+  return d->color.next();
+}
+
+
+IRFrameData &FrameSynchronizer::irSlot(void)
+{
+  Q_D(FrameSynchronizer);
+  return d->ir.next();
+}
+
+
+void FrameSynchronizer::commitDepth(void)
+{
+  Q_D(FrameSynchronizer);
+  // the color or IR stream is stalled
+  if (!d->depth.commit())
+    d->discardedFrameSets.ref();
+}
+
+
+void FrameSynchronizer::commitColor(void)
+{
+  Q_D(FrameSynchronizer);
+  d->color.commit();
+}
+
+
+void FrameSynchronizer::commitIR(void)
+{
+  Q_D(FrameSynchronizer);
+  d->ir.commit();
+}
+
+
+bool FrameSynchronizer::match(void)
+{
+  Q_D(FrameSynchronizer);
+  while (d->depth.count > 0) {
+    const INT64 timestamp = d->depth.at(0).timestamp;
+    bool colorMissed = false;
+    bool irMissed = false;
+    d->colorIndex = d->color.findMatch(timestamp, d->skewTolerance, colorMissed);
+    d->irIndex = d->ir.findMatch(timestamp, d->skewTolerance, irMissed);
+    if (colorMissed || irMissed) {
+      d->depth.dropFront(1);
+      d->discardedFrameSets.ref();
+      continue;
+    }
+    return d->colorIndex >= 0 && d->irIndex >= 0;
+  }
+  return false;
+}
+
+
+FrameSet FrameSynchronizer::takeFrameSet(void)
+{
+  Q_D(FrameSynchronizer);
+  Q_ASSERT_X(d->depth.count > 0 && d->colorIndex >= 0 && d->irIndex >= 0, "FrameSynchronizer::takeFrameSet()", "no matched set available");
+  FrameSet frameSet;
+  frameSet.depth = d->depth.take(0);
+  frameSet.color = d->color.take(d->colorIndex);
+  frameSet.ir = d->ir.take(d->irIndex);
+  d->colorIndex = -1;
+  d->irIndex = -1;
+  return frameSet;
+}
+
+
+int FrameSynchronizer::discardedFrameSets(void) const
+{
+  Q_D(const FrameSynchronizer);
+  return d->discardedFrameSets.load();
+}
@@ -0,0 +1,65 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __FRAMESYNCHRONIZER_H_
+#define __FRAMESYNCHRONIZER_H_
+
+#include <QScopedPointer>
+
+#include "frameset.h"
+
+class FrameSynchronizerPrivate;
+
+// Buffers the last few frames of each stream and pairs every depth
+// frame with the color and infrared frames closest to it in time.
+// Depth frames without partners within the skew tolerance are
+// discarded. Frames are acquired into the pooled frames handed out by
+// the *Slot() methods and then passed on by reference.
+class FrameSynchronizer
+{
+public:
+  // RelativeTime ticks are 100 ns, so this is half a frame at 30 Hz
+  static const INT64 DefaultSkewTolerance = 166667;
+
+  explicit FrameSynchronizer(INT64 skewTolerance = DefaultSkewTolerance);
+  ~FrameSynchronizer();
+
+  void setSkewTolerance(INT64);
+  INT64 skewTolerance(void) const;
+
+  DepthFrameData &depthSlot(void);
+  ColorFrameData &colorSlot(void);
+  IRFrameData &irSlot(void);
+  void commitDepth(void);
+  void commitColor(void);
+  void commitIR(void);
+
+  // true if a matched set is ready to be taken
+  bool match(void);
+  FrameSet takeFrameSet(void);
+
+  int discardedFrameSets(void) const;
+
+private:
+  QScopedPointer<FrameSynchronizerPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(FrameSynchronizer)
+  Q_DISABLE_COPY(FrameSynchronizer)
+};
+
+#endif // __FRAMESYNCHRONIZER_H_
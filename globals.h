@@ -30,5 +30,13 @@ static const int ColorWidth = 1920;
 static const int ColorHeight = 1080;
 static const int ColorSize = ColorWidth * ColorHeight;
 
+// initial settings of the removal
+static const int DefaultHaloSize = 10;
+static const int DefaultNearThreshold = 1589;
+static const int DefaultFarThreshold = 1903;
+static const double DefaultSaturation = 1.3;
+static const double DefaultGamma = 1.4;
+static const double DefaultContrast = 1.1;
+
 #endif // __GLOBALS_H_
 
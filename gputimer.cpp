@@ -0,0 +1,181 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "gputimer.h"
+
+#include <algorithm>
+
+
+// queries in flight per stage; the results are usually there after one or two frames
+static const int QueryRingSize = 4;
+// the percentiles are taken over this many of the latest samples
+static const int SampleWindowSize = 256;
+
+
+class GpuTimerPrivate {
+public:
+  struct Stage {
+    Stage(void)
+      : head(0)
+      , pending(0)
+      , sampleIndex(0)
+    {
+      for (int i = 0; i < QueryRingSize; ++i)
+        queries[i] = 0;
+    }
+    QString name;
+    GLuint queries[QueryRingSize];
+    // the next query to issue and how many before it are pending
+    int head;
+    int pending;
+    // in nanoseconds, a ring once it's full
+    QVector<GLuint> samples;
+    int sampleIndex;
+  };
+
+  GpuTimerPrivate(const QStringList &stageNames)
+    : initialized(false)
+    , activeStage(-1)
+  {
+    stages.resize(stageNames.count());
+    for (int i = 0; i < stageNames.count(); ++i) {
+      stages[i].name = stageNames.at(i);
+      stages[i].samples.reserve(SampleWindowSize);
+    }
+  }
+
+  static qreal percentile(QVector<GLuint> samples, qreal p);
+
+  QVector<Stage> stages;
+  bool initialized;
+  int activeStage;
+};
+
+
+qreal GpuTimerPrivate::percentile(QVector<GLuint> samples, qreal p)
+{
+  if (samples.isEmpty())
+    return 0.0;
+  const int rank = qRound(p * (samples.count() - 1));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return 1e-6 * samples.at(rank);
+}
+
+
+GpuTimer::GpuTimer(const QStringList &stages)
+  : d_ptr(new GpuTimerPrivate(stages))
+{
+  // ...
+}
+
+
+GpuTimer::~GpuTimer()
+{
+  Q_D(GpuTimer);
+  if (!d->initialized)
+    return;
+  for (int i = 0; i < d->stages.count(); ++i)
+    glDeleteQueries(QueryRingSize, d->stages[i].queries);
+}
+
+
+void GpuTimer::initialize(void)
+{
+  Q_D(GpuTimer);
+  initializeOpenGLFunctions();
+  for (int i = 0; i < d->stages.count(); ++i)
+    glGenQueries(QueryRingSize, d->stages[i].queries);
+  d->initialized = true;
+}
+
+
+bool GpuTimer::isInitialized(void) const
+{
+  Q_D(const GpuTimer);
+  return d->initialized;
+}
+
+
+void GpuTimer::begin(int stage)
+{
+  Q_D(GpuTimer);
+  Q_ASSERT_X(d->activeStage < 0, "GpuTimer::begin()", "the previous stage hasn't ended");
+  if (!d->initialized)
+    return;
+  GpuTimerPrivate::Stage &s = d->stages[stage];
+  if (s.pending == QueryRingSize)
+    return;
+  glBeginQuery(GL_TIME_ELAPSED, s.queries[s.head]);
+  d->activeStage = stage;
+}
+
+
+void GpuTimer::end(void)
+{
+  Q_D(GpuTimer);
+  if (d->activeStage < 0)
+    return;
+  GpuTimerPrivate::Stage &s = d->stages[d->activeStage];
+  glEndQuery(GL_TIME_ELAPSED);
+  s.head = (s.head + 1) % QueryRingSize;
+  ++s.pending;
+  d->activeStage = -1;
+}
+
+
+void GpuTimer::collect(void)
+{
+  Q_D(GpuTimer);
+  for (int i = 0; i < d->stages.count(); ++i) {
+    GpuTimerPrivate::Stage &s = d->stages[i];
+    while (s.pending > 0) {
+      const GLuint query = s.queries[(s.head - s.pending + QueryRingSize) % QueryRingSize];
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == GL_FALSE)
+        break;
+      // 32 bits of nanoseconds are good for more than four seconds
+      GLuint ns = 0;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT, &ns);
+      if (s.samples.count() < SampleWindowSize)
+        s.samples.append(ns);
+      else
+        s.samples[s.sampleIndex] = ns;
+      s.sampleIndex = (s.sampleIndex + 1) % SampleWindowSize;
+      --s.pending;
+    }
+  }
+}
+
+
+QVector<GpuTimer::Timing> GpuTimer::timings(void) const
+{
+  Q_D(const GpuTimer);
+  QVector<Timing> result;
+  result.reserve(d->stages.count());
+  foreach (const GpuTimerPrivate::Stage &s, d->stages) {
+    Timing timing;
+    timing.stage = s.name;
+    timing.samples = s.samples.count();
+    timing.p50 = GpuTimerPrivate::percentile(s.samples, .5);
+    timing.p99 = GpuTimerPrivate::percentile(s.samples, .99);
+    result.append(timing);
+  }
+  return result;
+}
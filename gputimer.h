@@ -0,0 +1,68 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __GPUTIMER_H_
+#define __GPUTIMER_H_
+
+#include <QScopedPointer>
+#include <QOpenGLExtraFunctions>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class GpuTimerPrivate;
+
+// Measures how long the GPU takes for each of a number of stages with
+// GL_TIME_ELAPSED queries. Every stage has a small ring of queries, so
+// that the results are read a few frames late when they're ready
+// instead of waiting for the GPU. A stage whose ring is still full of
+// pending queries simply isn't measured that time.
+class GpuTimer : protected QOpenGLExtraFunctions
+{
+public:
+  struct Timing {
+    QString stage;
+    int samples;
+    // in milliseconds, over the latest samples
+    qreal p50;
+    qreal p99;
+  };
+
+  explicit GpuTimer(const QStringList &stages);
+  ~GpuTimer();
+
+  // creates the queries in the current context
+  void initialize(void);
+  bool isInitialized(void) const;
+
+  // the queries of different stages mustn't overlap
+  void begin(int stage);
+  void end(void);
+  // takes over the results that are available, without blocking
+  void collect(void);
+
+  QVector<Timing> timings(void) const;
+
+private:
+  QScopedPointer<GpuTimerPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(GpuTimer)
+  Q_DISABLE_COPY(GpuTimer)
+};
+
+#endif // __GPUTIMER_H_
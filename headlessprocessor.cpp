@@ -0,0 +1,359 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "util.h"
+#include "framesource.h"
+#include "capturethread.h"
+#include "framerenderer.h"
+#include "cpurenderer.h"
+#include "headlessprocessor.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+
+// how often the frame rate is reported, in milliseconds
+static const qint64 ReportInterval = 5000;
+
+
+static void applyDefaults(RemovalEngine *engine)
+{
+  engine->setHaloSize(DefaultHaloSize);
+  engine->setNearThreshold(float(DefaultNearThreshold));
+  engine->setFarThreshold(float(DefaultFarThreshold));
+  engine->setSaturation(float(DefaultSaturation));
+  engine->setGamma(float(DefaultGamma));
+  engine->setContrast(float(DefaultContrast));
+}
+
+
+class HeadlessProcessorPrivate {
+public:
+  HeadlessProcessorPrivate(FrameSource *frameSource)
+    : frameSource(frameSource)
+    , captureThread(nullptr)
+    , context(nullptr)
+    , surface(nullptr)
+    , renderer(nullptr)
+    , cpuRenderer(nullptr)
+    , engine(HeadlessProcessor::GpuEngine)
+    , forwardMapping(false)
+    , processingScale(1)
+    , frameLimit(0)
+    , frameCount(0)
+    , reportFrameCount(0)
+    , comparedPixels(0)
+    , identicalPixels(0)
+    , offByOnePixels(0)
+    , maxDifference(0)
+  { /* ... */ }
+  ~HeadlessProcessorPrivate()
+  {
+    SafeDelete(captureThread);
+    SafeDelete(cpuRenderer);
+    if (context != nullptr && surface != nullptr) {
+      // the renderer releases its GL resources
+      context->makeCurrent(surface);
+      SafeDelete(renderer);
+      context->doneCurrent();
+    }
+    SafeDelete(context);
+    SafeDelete(surface);
+    SafeDelete(frameSource);
+  }
+
+  FrameSource *frameSource;
+  CaptureThread *captureThread;
+  QOpenGLContext *context;
+  QOffscreenSurface *surface;
+  FrameRenderer *renderer;
+  CpuRenderer *cpuRenderer;
+  HeadlessProcessor::Engine engine;
+  bool forwardMapping;
+  int processingScale;
+  QString outputDirectory;
+  int frameLimit;
+  int frameCount;
+  int reportFrameCount;
+  QElapsedTimer timer;
+  QElapsedTimer reportTimer;
+  qint64 comparedPixels;
+  qint64 identicalPixels;
+  // by one level in at least one channel
+  qint64 offByOnePixels;
+  int maxDifference;
+};
+
+
+HeadlessProcessor::HeadlessProcessor(FrameSource *frameSource, QObject *parent)
+  : QObject(parent)
+  , d_ptr(new HeadlessProcessorPrivate(frameSource))
+{
+  Q_D(HeadlessProcessor);
+  Q_ASSERT_X(d->frameSource != nullptr, "HeadlessProcessor::HeadlessProcessor()", "frame source must not be null");
+  d->captureThread = new CaptureThread(d->frameSource);
+  QObject::connect(d->captureThread, SIGNAL(framesAvailable()), SLOT(processFrames()));
+  qRegisterMetaType<SensorCalibration>();
+  QObject::connect(d->captureThread, SIGNAL(calibrationAvailable(SensorCalibration)), SLOT(setCalibration(SensorCalibration)));
+}
+
+
+HeadlessProcessor::~HeadlessProcessor()
+{
+  // ...
+}
+
+
+void HeadlessProcessor::preparePlatform(void)
+{
+  if (!qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    return;
+  // eglfs without a device integration takes the default EGL display,
+  // which Mesa makes surfaceless on request; the offscreen surface then
+  // needs neither a window nor a pbuffer
+  qputenv("QT_QPA_PLATFORM", "eglfs");
+  if (qEnvironmentVariableIsEmpty("QT_QPA_EGLFS_INTEGRATION"))
+    qputenv("QT_QPA_EGLFS_INTEGRATION", "none");
+  if (qEnvironmentVariableIsEmpty("EGL_PLATFORM"))
+    qputenv("EGL_PLATFORM", "surfaceless");
+  qputenv("QT_QPA_EGLFS_DISABLE_INPUT", "1");
+}
+
+
+bool HeadlessProcessor::start(void)
+{
+  Q_D(HeadlessProcessor);
+  if (!d->frameSource->open()) {
+    qWarning() << "HeadlessProcessor: cannot open the frame source";
+    return false;
+  }
+  if (d->engine != GpuEngine) {
+    if (d->forwardMapping) {
+      qWarning() << "HeadlessProcessor: the CPU engine needs the color to depth mapping, it can't be combined with the forward mapping";
+      return false;
+    }
+    if (d->processingScale > 1)
+      qWarning() << "HeadlessProcessor: the CPU engine decides for every pixel, the processing scale only applies to the GPU";
+    d->cpuRenderer = new CpuRenderer;
+    applyDefaults(d->cpuRenderer);
+  }
+  if (d->engine != CpuEngine && !startGpu())
+    return false;
+
+  if (!d->outputDirectory.isEmpty() && !QDir().mkpath(d->outputDirectory)) {
+    qWarning() << "HeadlessProcessor: cannot create" << d->outputDirectory;
+    return false;
+  }
+
+  d->timer.start();
+  d->reportTimer.start();
+  d->captureThread->start(QThread::TimeCriticalPriority);
+  return true;
+}
+
+
+bool HeadlessProcessor::startGpu(void)
+{
+  Q_D(HeadlessProcessor);
+  d->context = new QOpenGLContext;
+  d->context->setFormat(FrameRenderer::surfaceFormat());
+  if (!d->context->create()) {
+    qWarning() << "HeadlessProcessor: cannot create an OpenGL context on platform" << QGuiApplication::platformName();
+    return false;
+  }
+  d->surface = new QOffscreenSurface;
+  d->surface->setFormat(d->context->format());
+  d->surface->create();
+  if (!d->context->makeCurrent(d->surface)) {
+    qWarning() << "HeadlessProcessor: cannot make the OpenGL context current offscreen";
+    return false;
+  }
+  const QSurfaceFormat &actual = d->context->format();
+  qDebug() << "HeadlessProcessor: OpenGL" << actual.majorVersion() << "." << actual.minorVersion() << "on platform" << QGuiApplication::platformName();
+
+  d->renderer = new FrameRenderer;
+  d->renderer->initialize();
+  d->renderer->setForwardMapping(d->forwardMapping);
+  d->renderer->setProcessingScale(d->processingScale);
+  applyDefaults(d->renderer);
+  return true;
+}
+
+
+void HeadlessProcessor::setEngine(Engine engine)
+{
+  Q_D(HeadlessProcessor);
+  d->engine = engine;
+}
+
+
+void HeadlessProcessor::setMaxSkew(double ms)
+{
+  Q_D(HeadlessProcessor);
+  d->captureThread->setSkewTolerance(INT64(ms * 1e4));
+}
+
+
+void HeadlessProcessor::setForwardMapping(bool enabled)
+{
+  Q_D(HeadlessProcessor);
+  d->forwardMapping = enabled;
+  d->captureThread->setColorMapping(!enabled);
+}
+
+
+void HeadlessProcessor::setProcessingScale(int divisor)
+{
+  Q_D(HeadlessProcessor);
+  d->processingScale = divisor;
+}
+
+
+void HeadlessProcessor::setRemapTolerance(int mm)
+{
+  Q_D(HeadlessProcessor);
+  d->captureThread->setRemapTolerance(mm);
+}
+
+
+void HeadlessProcessor::setOutputDirectory(const QString &path)
+{
+  Q_D(HeadlessProcessor);
+  d->outputDirectory = path;
+}
+
+
+void HeadlessProcessor::setFrameLimit(int frames)
+{
+  Q_D(HeadlessProcessor);
+  d->frameLimit = frames;
+}
+
+
+void HeadlessProcessor::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(HeadlessProcessor);
+  if (d->renderer == nullptr)
+    return;
+  d->context->makeCurrent(d->surface);
+  d->renderer->setCalibration(calibration);
+}
+
+
+void HeadlessProcessor::processFrames(void)
+{
+  Q_D(HeadlessProcessor);
+  if ((d->renderer == nullptr && d->cpuRenderer == nullptr) || (d->frameLimit > 0 && d->frameCount >= d->frameLimit))
+    return;
+  const FrameSet &frameSet = d->captureThread->takeLatestFrameSet();
+  if (frameSet.isNull())
+    return;
+
+  if (d->renderer != nullptr) {
+    d->context->makeCurrent(d->surface);
+    d->renderer->process(frameSet);
+    d->renderer->renderImage();
+  }
+  if (d->cpuRenderer != nullptr) {
+    d->cpuRenderer->process(frameSet);
+    d->cpuRenderer->renderImage();
+  }
+  if (d->engine == VerifyCpuEngine)
+    compareImages();
+  ++d->frameCount;
+  ++d->reportFrameCount;
+  if (!d->outputDirectory.isEmpty()) {
+    RemovalEngine *engine = d->engine == CpuEngine ? static_cast<RemovalEngine*>(d->cpuRenderer) : d->renderer;
+    const QString &fileName = QDir(d->outputDirectory).filePath(QString("frame-%1.png").arg(d->frameCount, 6, 10, QChar('0')));
+    if (!engine->image().save(fileName))
+      qWarning() << "HeadlessProcessor: cannot write" << fileName;
+  }
+
+  if (d->reportTimer.elapsed() >= ReportInterval) {
+    qDebug() << "HeadlessProcessor:" << 1e3 * d->reportFrameCount / d->reportTimer.elapsed() << "fps,"
+             << d->captureThread->droppedFrameSets() << "frame sets dropped";
+    reportTimings();
+    d->reportFrameCount = 0;
+    d->reportTimer.restart();
+  }
+  if (d->frameLimit > 0 && d->frameCount >= d->frameLimit)
+    finish();
+}
+
+
+void HeadlessProcessor::compareImages(void)
+{
+  Q_D(HeadlessProcessor);
+  const QImage &gpu = d->renderer->image().convertToFormat(QImage::Format_RGB32);
+  const QImage &cpu = d->cpuRenderer->image();
+  for (int y = 0; y < ColorHeight; ++y) {
+    const QRgb *a = reinterpret_cast<const QRgb*>(gpu.constScanLine(y));
+    const QRgb *b = reinterpret_cast<const QRgb*>(cpu.constScanLine(y));
+    for (int x = 0; x < ColorWidth; ++x) {
+      const int difference = qMax(qAbs(qRed(a[x]) - qRed(b[x])), qMax(qAbs(qGreen(a[x]) - qGreen(b[x])), qAbs(qBlue(a[x]) - qBlue(b[x]))));
+      if (difference == 0)
+        ++d->identicalPixels;
+      else if (difference == 1)
+        ++d->offByOnePixels;
+      d->maxDifference = qMax(d->maxDifference, difference);
+    }
+  }
+  d->comparedPixels += ColorSize;
+}
+
+
+void HeadlessProcessor::reportTimings(void)
+{
+  Q_D(HeadlessProcessor);
+  if (d->renderer == nullptr)
+    return;
+  foreach (const GpuTimer::Timing &timing, d->renderer->timings()) {
+    if (timing.samples > 0)
+      qDebug() << "HeadlessProcessor:" << qPrintable(timing.stage) << "takes" << timing.p50 << "ms (p50)," << timing.p99 << "ms (p99) on the GPU";
+  }
+}
+
+
+void HeadlessProcessor::finish(void)
+{
+  Q_D(HeadlessProcessor);
+  d->captureThread->stop();
+  // let the GPU finish, so that the rate isn't flattered by queued work
+  if (d->context != nullptr)
+    d->context->functions()->glFinish();
+  const qint64 ms = qMax(d->timer.elapsed(), qint64(1));
+  qDebug() << "HeadlessProcessor: processed" << d->frameCount << "frame sets in" << ms << "ms,"
+           << 1e3 * d->frameCount / ms << "fps sustained,"
+           << d->captureThread->droppedFrameSets() << "dropped,"
+           << d->captureThread->discardedFrameSets() << "discarded";
+  reportTimings();
+  if (d->engine == VerifyCpuEngine) {
+    const double pixels = double(qMax(d->comparedPixels, qint64(1)));
+    qDebug() << "HeadlessProcessor: CPU and GPU images identical in" << 100.0 * d->identicalPixels / pixels << "% of the pixels,"
+             << "off by one level in" << 100.0 * d->offByOnePixels / pixels << "%,"
+             << "at most" << d->maxDifference << "levels apart";
+  }
+  QCoreApplication::quit();
+}
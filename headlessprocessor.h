@@ -0,0 +1,88 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __HEADLESSPROCESSOR_H_
+#define __HEADLESSPROCESSOR_H_
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QString>
+
+#include "sensorcalibration.h"
+
+class FrameSource;
+class HeadlessProcessorPrivate;
+
+// Runs the removal pipeline of the ThreeDWidget without a window: the
+// frame sets from the capture thread are rendered by a FrameRenderer
+// in an offscreen OpenGL context, or by a CpuRenderer, so that W-1 can
+// process sessions on hosts without a display or GPU. Reports the
+// sustained frame rate and optionally writes the resulting images out.
+class HeadlessProcessor : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Engine {
+    GpuEngine,
+    CpuEngine,
+    // both, with the CPU's images compared to the GPU's
+    VerifyCpuEngine
+  };
+
+  explicit HeadlessProcessor(FrameSource *frameSource, QObject *parent = nullptr);
+  ~HeadlessProcessor();
+
+  // Must be called before the QGuiApplication is constructed. Selects
+  // a platform plugin that renders through EGL without a display
+  // (e.g. Mesa's llvmpipe with EGL_PLATFORM=surfaceless), unless
+  // QT_QPA_PLATFORM says otherwise.
+  static void preparePlatform(void);
+
+  // false if the frame source can't be opened or no OpenGL context
+  // could be made current offscreen
+  bool start(void);
+
+  void setEngine(Engine);
+  void setMaxSkew(double ms);
+  void setForwardMapping(bool enabled);
+  // see FrameRenderer::setProcessingScale(), the CPU engine ignores it
+  void setProcessingScale(int divisor);
+  void setRemapTolerance(int mm);
+  // writes every processed image into the directory as PNG
+  void setOutputDirectory(const QString&);
+  // quits the application after that many frame sets, 0 means never
+  void setFrameLimit(int);
+
+private slots:
+  void processFrames(void);
+  void setCalibration(const SensorCalibration&);
+
+private:
+  QScopedPointer<HeadlessProcessorPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(HeadlessProcessor)
+  Q_DISABLE_COPY(HeadlessProcessor)
+
+  bool startGpu(void);
+  void compareImages(void);
+  void reportTimings(void);
+  void finish(void);
+};
+
+#endif // __HEADLESSPROCESSOR_H_
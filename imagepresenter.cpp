@@ -0,0 +1,195 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "util.h"
+#include "imagepresenter.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QStringList>
+#include <QVector2D>
+
+
+static const int PROGRAM_VERTEX_ATTRIBUTE = 0;
+static const int PROGRAM_TEXCOORD_ATTRIBUTE = 1;
+static const QVector2D Vertices[4] = {
+  QVector2D(+1.920f, +1.080f),
+  QVector2D(+1.920f, -1.080f),
+  QVector2D(-1.920f, +1.080f),
+  QVector2D(-1.920f, -1.080f)
+};
+static const QVector2D TexCoords[4] = {
+  QVector2D(0, 0),
+  QVector2D(0, 1),
+  QVector2D(1, 0),
+  QVector2D(1, 1)
+};
+// the vertex buffer holds the quad followed by its texture coordinates
+static const int VerticesOffset = 0;
+static const int TexCoordsOffset = VerticesOffset + int(sizeof(Vertices));
+static const int QuadBufferSize = TexCoordsOffset + int(sizeof(TexCoords));
+
+
+class ImagePresenterPrivate {
+public:
+  ImagePresenterPrivate(void)
+    : program(nullptr)
+    , quadBuffer(QOpenGLBuffer::VertexBuffer)
+    , imageTexture(0)
+    , timer(QStringList() << "present")
+  { /* ... */ }
+  ~ImagePresenterPrivate()
+  {
+    SafeDelete(program);
+  }
+
+  QOpenGLShaderProgram *program;
+  GLint mvMatrixLocation;
+  QOpenGLBuffer quadBuffer;
+  QOpenGLVertexArrayObject screenQuad;
+  GLuint imageTexture;
+  GpuTimer timer;
+};
+
+
+ImagePresenter::ImagePresenter(void)
+  : d_ptr(new ImagePresenterPrivate)
+{
+  // ...
+}
+
+
+ImagePresenter::~ImagePresenter()
+{
+  // ...
+}
+
+
+void ImagePresenter::initialize(void)
+{
+  Q_D(ImagePresenter);
+  initializeOpenGLFunctions();
+
+  const QOpenGLContext *glContext = QOpenGLContext::currentContext();
+  if (glContext->format().version() >= qMakePair(3, 3) || glContext->hasExtension("GL_ARB_timer_query"))
+    d->timer.initialize();
+
+  d->program = new QOpenGLShaderProgram;
+  d->program->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/mix.vs.glsl");
+  d->program->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/present.fs.glsl");
+  d->program->bindAttributeLocation("aVertex", PROGRAM_VERTEX_ATTRIBUTE);
+  d->program->bindAttributeLocation("aTexCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
+  d->program->link();
+  qDebug() << "Present shader linker says:" << d->program->log();
+  Q_ASSERT_X(d->program->isLinked(), "ImagePresenter::initialize()", "error in present shader program");
+  d->program->bind();
+  d->program->setUniformValue("uImageTexture", 0);
+  d->mvMatrixLocation = d->program->uniformLocation("uMatrix");
+
+  d->quadBuffer.create();
+  d->quadBuffer.bind();
+  d->quadBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+  d->quadBuffer.allocate(QuadBufferSize);
+  d->quadBuffer.write(VerticesOffset, Vertices, int(sizeof(Vertices)));
+  d->quadBuffer.write(TexCoordsOffset, TexCoords, int(sizeof(TexCoords)));
+  d->screenQuad.create();
+  d->screenQuad.bind();
+  d->program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
+  d->program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, VerticesOffset, 2);
+  d->program->enableAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE);
+  d->program->setAttributeBuffer(PROGRAM_TEXCOORD_ATTRIBUTE, GL_FLOAT, TexCoordsOffset, 2);
+  d->screenQuad.release();
+  d->quadBuffer.release();
+}
+
+
+bool ImagePresenter::isInitialized(void) const
+{
+  Q_D(const ImagePresenter);
+  return d->program != nullptr && d->program->isLinked();
+}
+
+
+bool ImagePresenter::hasImage(void) const
+{
+  Q_D(const ImagePresenter);
+  return d->imageTexture != 0;
+}
+
+
+void ImagePresenter::setImage(GLuint texture, GLsync fence)
+{
+  Q_D(ImagePresenter);
+  Q_ASSERT_X(d->imageTexture == 0, "ImagePresenter::setImage()", "the image before must be released first");
+  if (fence != nullptr) {
+    // only the GPU waits, this thread goes on
+    glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fence);
+  }
+  d->imageTexture = texture;
+}
+
+
+GLuint ImagePresenter::releaseImage(GLsync *fence)
+{
+  Q_D(ImagePresenter);
+  const GLuint texture = d->imageTexture;
+  *fence = nullptr;
+  if (texture != 0) {
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // the render thread's context only sees it once it's flushed
+    glFlush();
+    d->imageTexture = 0;
+  }
+  return texture;
+}
+
+
+void ImagePresenter::draw(const QMatrix4x4 &mvMatrix, int width, int height)
+{
+  Q_D(ImagePresenter);
+  d->timer.collect();
+  glClearColor(.15f, .15f, .15f, 1.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  if (d->imageTexture == 0)
+    return;
+  d->timer.begin(0);
+  // a QPainter may have used the texture unit since the last time
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, d->imageTexture);
+  d->program->bind();
+  d->screenQuad.bind();
+  d->program->setUniformValue(d->mvMatrixLocation, mvMatrix);
+  glViewport(0, 0, width, height);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  d->screenQuad.release();
+  d->timer.end();
+}
+
+
+QVector<GpuTimer::Timing> ImagePresenter::timings(void) const
+{
+  Q_D(const ImagePresenter);
+  if (!d->timer.isInitialized())
+    return QVector<GpuTimer::Timing>();
+  return d->timer.timings();
+}
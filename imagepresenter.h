@@ -0,0 +1,66 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __IMAGEPRESENTER_H_
+#define __IMAGEPRESENTER_H_
+
+#include <QScopedPointer>
+#include <QOpenGLExtraFunctions>
+#include <QMatrix4x4>
+#include <QVector>
+
+#include "gputimer.h"
+
+class ImagePresenterPrivate;
+
+// Draws the images a RenderThread renders in its own context into the
+// current one, placed in the world by a matrix. Like the FrameRenderer
+// it expects the context that was current when initialize() was
+// called to be current again.
+class ImagePresenter : protected QOpenGLExtraFunctions
+{
+public:
+  ImagePresenter(void);
+  ~ImagePresenter();
+
+  void initialize(void);
+  bool isInitialized(void) const;
+  bool hasImage(void) const;
+
+  // makes the texture the one to draw once the fence has been passed
+  // on the GPU and deletes the fence; the image before has to be
+  // released first
+  void setImage(GLuint texture, GLsync fence);
+  // stops drawing the image and returns its texture, or 0 if there's
+  // none. The fence is passed once the GPU is done with what's been
+  // drawn from it; it's flushed already.
+  GLuint releaseImage(GLsync *fence);
+  // draws the image into the currently bound framebuffer of the given size
+  void draw(const QMatrix4x4 &mvMatrix, int width, int height);
+
+  // see FrameRenderer::timings()
+  QVector<GpuTimer::Timing> timings(void) const;
+
+private:
+  QScopedPointer<ImagePresenterPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(ImagePresenter)
+  Q_DISABLE_COPY(ImagePresenter)
+};
+
+#endif // __IMAGEPRESENTER_H_
@@ -78,15 +78,15 @@ IRWidget::IRWidget(QWidget *parent)
 }
 
 
-void IRWidget::setIRData(INT64 nTime, const UINT16 *pBuffer, int nWidth, int nHeight)
+void IRWidget::setIRFrame(const IRFrameRef &frame)
 {
   Q_D(IRWidget);
-  Q_UNUSED(nTime);
 
-  if (nWidth != IRWidth || nHeight != IRHeight || pBuffer == nullptr)
+  if (frame.isNull() || frame->width != IRWidth || frame->height != IRHeight)
     return;
 
-  const UINT16* pBufferEnd = pBuffer + nWidth * nHeight;
+  const UINT16 *pBuffer = frame->buffer;
+  const UINT16 *const pBufferEnd = pBuffer + IRSize;
   QRgb *dst = reinterpret_cast<QRgb*>(d->irFrame.bits());
   while (pBuffer < pBufferEnd) {
     float intensityRatio = float(*pBuffer)
@@ -20,7 +20,8 @@
 #ifndef __IRWIDGET_H_
 #define __IRWIDGET_H_
 
-#include <Kinect.h>
+#include "kinectcompat.h"
+#include "frameset.h"
 
 #include <QWidget>
 #include <QPaintEvent>
@@ -35,7 +36,7 @@ class IRWidget : public QWidget
 
 public:
   explicit IRWidget(QWidget *parent = nullptr);
-  void setIRData(INT64 nTime, const UINT16* pBuffer, int nWidth, int nHeight);
+  void setIRFrame(const IRFrameRef&);
 
 protected:
   void resizeEvent(QResizeEvent*);
@@ -0,0 +1,69 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __KINECTCOMPAT_H_
+#define __KINECTCOMPAT_H_
+
+// On Windows the real Kinect SDK 2.0 header is used. Everywhere else
+// only the handful of plain data types the processing pipeline shares
+// with the SDK are declared, so that everything except the Kinect
+// frame source builds without the SDK.
+
+#ifdef _WIN32
+
+#include <Kinect.h>
+
+#else
+
+#include <climits>
+#include <cstdint>
+
+typedef int64_t INT64;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef unsigned int UINT;
+typedef unsigned short USHORT;
+typedef uint8_t BYTE;
+
+struct RGBQUAD {
+  BYTE rgbBlue;
+  BYTE rgbGreen;
+  BYTE rgbRed;
+  BYTE rgbReserved;
+};
+
+struct DepthSpacePoint {
+  float X;
+  float Y;
+};
+
+struct ColorSpacePoint {
+  float X;
+  float Y;
+};
+
+struct CameraSpacePoint {
+  float X;
+  float Y;
+  float Z;
+};
+
+#endif
+
+#endif // __KINECTCOMPAT_H_
@@ -0,0 +1,411 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <Kinect.h>
+
+#include <QDebug>
+#include <QVector>
+
+#include "globals.h"
+#include "util.h"
+#include "kinectframesource.h"
+
+
+class KinectFrameSourcePrivate {
+public:
+  KinectFrameSourcePrivate(void)
+    : kinectSensor(nullptr)
+    , coordinateMapper(nullptr)
+    , depthFrameReader(nullptr)
+    , colorFrameReader(nullptr)
+    , irFrameReader(nullptr)
+    , depthFrameArrived(0)
+    , colorFrameArrived(0)
+    , irFrameArrived(0)
+    , colorFormat(ColorFormatBgra)
+    , hasCalibration(false)
+  { /* ... */ }
+  ~KinectFrameSourcePrivate()
+  {
+    // ...
+  }
+
+  IKinectSensor *kinectSensor;
+  ICoordinateMapper *coordinateMapper;
+  IDepthFrameReader *depthFrameReader;
+  IColorFrameReader *colorFrameReader;
+  IInfraredFrameReader *irFrameReader;
+
+  WAITABLE_HANDLE depthFrameArrived;
+  WAITABLE_HANDLE colorFrameArrived;
+  WAITABLE_HANDLE irFrameArrived;
+
+  ColorFormat colorFormat;
+
+  QString sensorId(void) const;
+  bool readCalibration(void);
+  SensorCalibration calibration;
+  bool hasCalibration;
+};
+
+
+QString KinectFrameSourcePrivate::sensorId(void) const
+{
+  WCHAR id[256];
+  if (kinectSensor == nullptr || FAILED(kinectSensor->get_UniqueKinectId(256, id)))
+    return QString("default");
+  return QString::fromWCharArray(id);
+}
+
+
+// The SDK reveals the depth intrinsics but neither the color intrinsics
+// nor the extrinsics. They are recovered by mapping a grid of depth
+// pixels at several distances into the color frame and fitting the
+// color projection to the result.
+bool KinectFrameSourcePrivate::readCalibration(void)
+{
+  static const int Step = 16;
+  static const int MinDepth = 500;
+  static const int MaxDepth = 4500;
+  static const int DepthStep = 250;
+  CameraIntrinsics intrinsics;
+  HRESULT hr = coordinateMapper->GetDepthCameraIntrinsics(&intrinsics);
+  // all zero until the sensor has delivered some frames
+  if (FAILED(hr) || intrinsics.FocalLengthX == 0.f)
+    return false;
+  calibration.depthFx = intrinsics.FocalLengthX;
+  calibration.depthFy = intrinsics.FocalLengthY;
+  calibration.depthCx = intrinsics.PrincipalPointX;
+  calibration.depthCy = intrinsics.PrincipalPointY;
+  calibration.depthK2 = intrinsics.RadialDistortionSecondOrder;
+  calibration.depthK4 = intrinsics.RadialDistortionFourthOrder;
+  calibration.depthK6 = intrinsics.RadialDistortionSixthOrder;
+  calibration.reserved = 0.f;
+
+  QVector<DepthSpacePoint> depthPoints;
+  QVector<UINT16> depths;
+  for (int z = MinDepth; z <= MaxDepth; z += DepthStep) {
+    for (int v = 0; v < DepthHeight; v += Step) {
+      for (int u = 0; u < DepthWidth; u += Step) {
+        DepthSpacePoint p;
+        p.X = float(u);
+        p.Y = float(v);
+        depthPoints.append(p);
+        depths.append(UINT16(z));
+      }
+    }
+  }
+  QVector<ColorSpacePoint> colorPoints(depthPoints.count());
+  hr = coordinateMapper->MapDepthPointsToColorSpace(UINT(depthPoints.count()), depthPoints.constData(), UINT(depths.count()), depths.constData(), UINT(colorPoints.count()), colorPoints.data());
+  if (FAILED(hr)) {
+    qWarning() << "MapDepthPointsToColorSpace() failed.";
+    return false;
+  }
+  QVector<CalibrationSample> samples;
+  samples.reserve(depthPoints.count());
+  for (int i = 0; i < depthPoints.count(); ++i) {
+    CalibrationSample sample;
+    sample.depthX = depthPoints.at(i).X;
+    sample.depthY = depthPoints.at(i).Y;
+    sample.depth = depths.at(i);
+    sample.colorX = colorPoints.at(i).X;
+    sample.colorY = colorPoints.at(i).Y;
+    samples.append(sample);
+  }
+  const double error = calibration.fitColorProjection(samples);
+  if (error < 0.0) {
+    qWarning() << "Cannot fit the color projection.";
+    return false;
+  }
+  qDebug() << "Calibration read from the sensor, RMS reprojection error" << error << "px";
+  return true;
+}
+
+
+KinectFrameSource::KinectFrameSource(void)
+  : d_ptr(new KinectFrameSourcePrivate)
+{
+  // ...
+}
+
+
+KinectFrameSource::~KinectFrameSource()
+{
+  close();
+}
+
+
+bool KinectFrameSource::open(void)
+{
+  Q_D(KinectFrameSource);
+
+  qDebug() << "KinectFrameSource::open()";
+
+  HRESULT hr;
+
+  hr = GetDefaultKinectSensor(&d->kinectSensor);
+  if (FAILED(hr))
+    return false;
+
+  if (d->kinectSensor != nullptr) {
+    IDepthFrameSource *pDepthFrameSource = nullptr;
+    hr = d->kinectSensor->Open();
+
+    if (SUCCEEDED(hr))
+      hr = d->kinectSensor->get_CoordinateMapper(&d->coordinateMapper);
+
+    if (SUCCEEDED(hr))
+      hr = d->kinectSensor->get_DepthFrameSource(&pDepthFrameSource);
+    if (SUCCEEDED(hr))
+      hr = pDepthFrameSource->OpenReader(&d->depthFrameReader);
+    if (SUCCEEDED(hr))
+      hr = d->depthFrameReader->SubscribeFrameArrived(&d->depthFrameArrived);
+    SafeRelease(pDepthFrameSource);
+
+    IColorFrameSource *pColorFrameSource = nullptr;
+    if (SUCCEEDED(hr))
+      hr = d->kinectSensor->get_ColorFrameSource(&pColorFrameSource);
+    if (SUCCEEDED(hr))
+      hr = pColorFrameSource->OpenReader(&d->colorFrameReader);
+    if (SUCCEEDED(hr))
+      hr = d->colorFrameReader->SubscribeFrameArrived(&d->colorFrameArrived);
+    SafeRelease(pColorFrameSource);
+
+    IInfraredFrameSource *pIRFrameSource = nullptr;
+    if (SUCCEEDED(hr))
+      hr = d->kinectSensor->get_InfraredFrameSource(&pIRFrameSource);
+    if (SUCCEEDED(hr))
+      hr = pIRFrameSource->OpenReader(&d->irFrameReader);
+    if (SUCCEEDED(hr))
+      hr = d->irFrameReader->SubscribeFrameArrived(&d->irFrameArrived);
+    SafeRelease(pIRFrameSource);
+  }
+
+  if (!d->kinectSensor || FAILED(hr)) {
+    qWarning() << "No ready Kinect found!";
+    return false;
+  }
+
+  return true;
+}
+
+
+void KinectFrameSource::close(void)
+{
+  Q_D(KinectFrameSource);
+  if (d->depthFrameReader != nullptr && d->depthFrameArrived != 0)
+    d->depthFrameReader->UnsubscribeFrameArrived(d->depthFrameArrived);
+  if (d->colorFrameReader != nullptr && d->colorFrameArrived != 0)
+    d->colorFrameReader->UnsubscribeFrameArrived(d->colorFrameArrived);
+  if (d->irFrameReader != nullptr && d->irFrameArrived != 0)
+    d->irFrameReader->UnsubscribeFrameArrived(d->irFrameArrived);
+  d->depthFrameArrived = 0;
+  d->colorFrameArrived = 0;
+  d->irFrameArrived = 0;
+  SafeRelease(d->depthFrameReader);
+  SafeRelease(d->colorFrameReader);
+  SafeRelease(d->irFrameReader);
+  SafeRelease(d->coordinateMapper);
+  d->hasCalibration = false;
+  if (d->kinectSensor)
+    d->kinectSensor->Close();
+  SafeRelease(d->kinectSensor);
+}
+
+
+bool KinectFrameSource::waitForFrames(int timeoutMs)
+{
+  Q_D(KinectFrameSource);
+  if (d->depthFrameArrived == 0 || d->colorFrameArrived == 0 || d->irFrameArrived == 0)
+    return false;
+  HANDLE events[3] = {
+    reinterpret_cast<HANDLE>(d->depthFrameArrived),
+    reinterpret_cast<HANDLE>(d->colorFrameArrived),
+    reinterpret_cast<HANDLE>(d->irFrameArrived)
+  };
+  const DWORD rc = WaitForMultipleObjects(3, events, FALSE, DWORD(timeoutMs));
+  // fetching the event data resets the event
+  switch (rc) {
+  case WAIT_OBJECT_0:
+  {
+    IDepthFrameArrivedEventArgs *args = nullptr;
+    d->depthFrameReader->GetFrameArrivedEventData(d->depthFrameArrived, &args);
+    SafeRelease(args);
+    return true;
+  }
+  case WAIT_OBJECT_0 + 1:
+  {
+    IColorFrameArrivedEventArgs *args = nullptr;
+    d->colorFrameReader->GetFrameArrivedEventData(d->colorFrameArrived, &args);
+    SafeRelease(args);
+    return true;
+  }
+  case WAIT_OBJECT_0 + 2:
+  {
+    IInfraredFrameArrivedEventArgs *args = nullptr;
+    d->irFrameReader->GetFrameArrivedEventData(d->irFrameArrived, &args);
+    SafeRelease(args);
+    return true;
+  }
+  default:
+    break;
+  }
+  return false;
+}
+
+
+void KinectFrameSource::setColorFormat(ColorFormat colorFormat)
+{
+  Q_D(KinectFrameSource);
+  d->colorFormat = colorFormat;
+}
+
+
+bool KinectFrameSource::acquireDepthFrame(DepthFrameData &frame)
+{
+  Q_D(KinectFrameSource);
+  if (d->depthFrameReader == nullptr)
+    return false;
+  IDepthFrame *depthFrame = nullptr;
+  HRESULT hr = d->depthFrameReader->AcquireLatestFrame(&depthFrame);
+  if (FAILED(hr))
+    return false;
+  IFrameDescription *depthFrameDescription = nullptr;
+  USHORT minDistance = 0;
+  USHORT maxDistance = 0;
+  hr = depthFrame->get_RelativeTime(&frame.timestamp);
+  if (SUCCEEDED(hr))
+    hr = depthFrame->get_FrameDescription(&depthFrameDescription);
+  if (SUCCEEDED(hr))
+    hr = depthFrameDescription->get_Width(&frame.width);
+  if (SUCCEEDED(hr))
+    hr = depthFrameDescription->get_Height(&frame.height);
+  if (SUCCEEDED(hr))
+    hr = depthFrame->get_DepthMinReliableDistance(&minDistance);
+  if (SUCCEEDED(hr)) {
+    maxDistance = USHRT_MAX;
+    hr = depthFrame->get_DepthMaxReliableDistance(&maxDistance);
+  }
+  if (SUCCEEDED(hr))
+    hr = depthFrame->CopyFrameDataToArray(DepthSize, frame.buffer);
+  SafeRelease(depthFrameDescription);
+  SafeRelease(depthFrame);
+  if (FAILED(hr))
+    return false;
+  frame.minReliableDistance = minDistance;
+  frame.maxReliableDistance = maxDistance;
+  return true;
+}
+
+
+bool KinectFrameSource::acquireIRFrame(IRFrameData &frame)
+{
+  Q_D(KinectFrameSource);
+  if (d->irFrameReader == nullptr)
+    return false;
+  IInfraredFrame *irFrame = nullptr;
+  HRESULT hr = d->irFrameReader->AcquireLatestFrame(&irFrame);
+  if (FAILED(hr))
+    return false;
+  IFrameDescription *irFrameDescription = nullptr;
+  hr = irFrame->get_RelativeTime(&frame.timestamp);
+  if (SUCCEEDED(hr))
+    hr = irFrame->get_FrameDescription(&irFrameDescription);
+  if (SUCCEEDED(hr))
+    hr = irFrameDescription->get_Width(&frame.width);
+  if (SUCCEEDED(hr))
+    hr = irFrameDescription->get_Height(&frame.height);
+  if (SUCCEEDED(hr))
+    hr = irFrame->CopyFrameDataToArray(IRSize, frame.buffer);
+  SafeRelease(irFrameDescription);
+  SafeRelease(irFrame);
+  return SUCCEEDED(hr);
+}
+
+
+bool KinectFrameSource::acquireColorFrame(ColorFrameData &frame)
+{
+  Q_D(KinectFrameSource);
+  if (d->colorFrameReader == nullptr)
+    return false;
+  IColorFrame *colorFrame = nullptr;
+  HRESULT hr = d->colorFrameReader->AcquireLatestFrame(&colorFrame);
+  if (FAILED(hr))
+    return false;
+  IFrameDescription *colorFrameDescription = nullptr;
+  ColorImageFormat imageFormat = ColorImageFormat_None;
+  hr = colorFrame->get_RelativeTime(&frame.timestamp);
+  if (SUCCEEDED(hr))
+    hr = colorFrame->get_FrameDescription(&colorFrameDescription);
+  if (SUCCEEDED(hr))
+    hr = colorFrameDescription->get_Width(&frame.width);
+  if (SUCCEEDED(hr))
+    hr = colorFrameDescription->get_Height(&frame.height);
+  if (SUCCEEDED(hr))
+    hr = colorFrame->get_RawColorImageFormat(&imageFormat);
+  if (SUCCEEDED(hr)) {
+    if (imageFormat == ColorImageFormat_Yuy2 && d->colorFormat == ColorFormatYuy2) {
+      // regular case: leave the conversion to the GPU
+      frame.format = ColorFormatYuy2;
+      hr = colorFrame->CopyRawFrameDataToArray(UINT(frame.byteSize()), reinterpret_cast<BYTE*>(frame.buffer));
+    }
+    else {
+      frame.format = ColorFormatBgra;
+      if (imageFormat == ColorImageFormat_Bgra)
+        hr = colorFrame->CopyRawFrameDataToArray(UINT(frame.byteSize()), reinterpret_cast<BYTE*>(frame.buffer));
+      else
+        hr = colorFrame->CopyConvertedFrameDataToArray(UINT(frame.byteSize()), reinterpret_cast<BYTE*>(frame.buffer), ColorImageFormat_Bgra);
+    }
+  }
+  SafeRelease(colorFrameDescription);
+  SafeRelease(colorFrame);
+  return SUCCEEDED(hr);
+}
+
+
+bool KinectFrameSource::mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DepthSpacePoint *depthSpacePoints)
+{
+  Q_D(KinectFrameSource);
+  if (d->coordinateMapper == nullptr)
+    return false;
+  HRESULT hr = d->coordinateMapper->MapColorFrameToDepthSpace(DepthSize, depthBuffer, ColorSize, depthSpacePoints);
+  if (FAILED(hr)) {
+    qWarning() << "MapColorFrameToDepthSpace() failed.";
+    return false;
+  }
+  return true;
+}
+
+
+bool KinectFrameSource::calibration(SensorCalibration &calibration)
+{
+  Q_D(KinectFrameSource);
+  if (!d->hasCalibration && d->coordinateMapper != nullptr) {
+    const QString cacheFileName = SensorCalibration::cacheFileName(d->sensorId());
+    d->hasCalibration = d->calibration.load(cacheFileName);
+    if (!d->hasCalibration && d->readCalibration()) {
+      d->calibration.save(cacheFileName);
+      d->hasCalibration = true;
+    }
+  }
+  if (!d->hasCalibration)
+    return false;
+  calibration = d->calibration;
+  return true;
+}
@@ -0,0 +1,54 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __KINECTFRAMESOURCE_H_
+#define __KINECTFRAMESOURCE_H_
+
+#include <QScopedPointer>
+
+#include "framesource.h"
+
+class KinectFrameSourcePrivate;
+
+class KinectFrameSource : public FrameSource
+{
+public:
+  KinectFrameSource(void);
+  ~KinectFrameSource();
+
+  virtual bool open(void);
+  virtual void close(void);
+  virtual bool isRealTime(void) const { return true; }
+  virtual bool waitForFrames(int timeoutMs);
+  virtual void setColorFormat(ColorFormat);
+
+  virtual bool acquireDepthFrame(DepthFrameData&);
+  virtual bool acquireColorFrame(ColorFrameData&);
+  virtual bool acquireIRFrame(IRFrameData&);
+
+  virtual bool mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DepthSpacePoint *depthSpacePoints);
+  virtual bool calibration(SensorCalibration&);
+
+private:
+  QScopedPointer<KinectFrameSourcePrivate> d_ptr;
+  Q_DECLARE_PRIVATE(KinectFrameSource)
+  Q_DISABLE_COPY(KinectFrameSource)
+};
+
+#endif // __KINECTFRAMESOURCE_H_
@@ -1,11 +1,129 @@
 #include "mainwindow.h"
+#include "framesource.h"
+#include "mappingcheck.h"
+#include "headlessprocessor.h"
+#include "framerenderer.h"
+#include <QCoreApplication>
 #include <QApplication>
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QScopedPointer>
+#include <QSurfaceFormat>
+#include <QDebug>
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
+    // without a display there must be neither a QApplication nor widgets,
+    // and without OpenGL not even a platform plugin
+    bool headless = false;
+    bool cpuOnly = false;
+    for (int i = 1; i < argc; ++i) {
+        headless = headless || strcmp(argv[i], "--headless") == 0;
+        cpuOnly = cpuOnly || strcmp(argv[i], "--cpu") == 0;
+    }
+    QScopedPointer<QCoreApplication> a;
+    if (headless && cpuOnly) {
+        a.reset(new QCoreApplication(argc, argv));
+    }
+    else if (headless) {
+        HeadlessProcessor::preparePlatform();
+        a.reset(new QGuiApplication(argc, argv));
+    }
+    else {
+        // the core profile has to be the default for QOpenGLWidget to
+        // get it on every platform
+        QSurfaceFormat::setDefaultFormat(FrameRenderer::surfaceFormat());
+        a.reset(new QApplication(argc, argv));
+    }
+    QCoreApplication::setApplicationName("W-1");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Whiteboard minus one");
+    parser.addHelpOption();
+    QCommandLineOption replayOption("replay", "Play back the recorded session <file> instead of reading from the Kinect.", "file");
+    parser.addOption(replayOption);
+    QCommandLineOption fullSpeedOption("full-speed", "Play back the recorded session as fast as possible instead of at recording pace.");
+    parser.addOption(fullSpeedOption);
+    QCommandLineOption yuy2Option("yuy2", "Upload the raw YUY2 color frames and convert them on the GPU.");
+    parser.addOption(yuy2Option);
+    QCommandLineOption maxSkewOption("max-skew", "Pair color, depth and IR frames only if their timestamps differ by at most <ms> milliseconds (default: 16.7).", "ms");
+    parser.addOption(maxSkewOption);
+    QCommandLineOption forwardMappingOption("forward-mapping", "Project the depth pixels into the color frame on the GPU instead of mapping every color pixel to depth on the CPU. The RGBD preview stays empty.");
+    parser.addOption(forwardMappingOption);
+    QCommandLineOption processingScaleOption("processing-scale", "Decide which pixels to keep at 1/<n> of the color resolution, n being 1, 2 or 4, and upsample the decision (default: 1).", "n");
+    parser.addOption(processingScaleOption);
+    QCommandLineOption remapToleranceOption("remap-tolerance", "Redo the color to depth mapping only where the depth changed by more than <mm> millimeters; 0 redoes it completely for every frame (default: 20).", "mm");
+    parser.addOption(remapToleranceOption);
+    QCommandLineOption recordOption("record", "Record the session to <file>.", "file");
+    parser.addOption(recordOption);
+    QCommandLineOption recordMappingOption("record-mapping", "Record the SDK's color to depth mapping along with the frames (8 MB per frame).");
+    parser.addOption(recordMappingOption);
+    QCommandLineOption verifyMappingOption("verify-mapping", "Compare the native color to depth mapping with the one recorded in the session <file> and quit.", "file");
+    parser.addOption(verifyMappingOption);
+    QCommandLineOption headlessOption("headless", "Run the removal without a window in an offscreen OpenGL context and report the frame rate.");
+    parser.addOption(headlessOption);
+    QCommandLineOption outputOption("output", "In headless mode, write the resulting images into <dir>.", "dir");
+    parser.addOption(outputOption);
+    QCommandLineOption framesOption("frames", "In headless mode, quit after <n> frame sets.", "n");
+    parser.addOption(framesOption);
+    QCommandLineOption cpuOption("cpu", "In headless mode, remove on the CPU instead of with OpenGL.");
+    parser.addOption(cpuOption);
+    QCommandLineOption verifyCpuOption("verify-cpu", "In headless mode, remove on both the GPU and the CPU and compare the images.");
+    parser.addOption(verifyCpuOption);
+    parser.process(*a);
+
+    if (parser.isSet(verifyMappingOption))
+        return verifyMapping(parser.value(verifyMappingOption));
+
+    const int processingScale = parser.isSet(processingScaleOption) ? parser.value(processingScaleOption).toInt() : 1;
+    if (processingScale != 1 && processingScale != 2 && processingScale != 4) {
+        qWarning() << "--processing-scale must be 1, 2 or 4";
+        return 1;
+    }
+
+    FrameSource *frameSource = FrameSource::create(parser.value(replayOption), parser.isSet(fullSpeedOption));
+    if (frameSource == nullptr)
+        return 1;
+    if (parser.isSet(yuy2Option))
+        frameSource->setColorFormat(ColorFormatYuy2);
+
+    if (headless) {
+        HeadlessProcessor processor(frameSource);
+        if (parser.isSet(maxSkewOption))
+            processor.setMaxSkew(parser.value(maxSkewOption).toDouble());
+        if (parser.isSet(forwardMappingOption))
+            processor.setForwardMapping(true);
+        if (parser.isSet(remapToleranceOption))
+            processor.setRemapTolerance(parser.value(remapToleranceOption).toInt());
+        processor.setProcessingScale(processingScale);
+        if (parser.isSet(outputOption))
+            processor.setOutputDirectory(parser.value(outputOption));
+        if (parser.isSet(framesOption))
+            processor.setFrameLimit(parser.value(framesOption).toInt());
+        if (parser.isSet(cpuOption))
+            processor.setEngine(HeadlessProcessor::CpuEngine);
+        else if (parser.isSet(verifyCpuOption))
+            processor.setEngine(HeadlessProcessor::VerifyCpuEngine);
+        if (!processor.start())
+            return 1;
+        return a->exec();
+    }
+
+    MainWindow w(frameSource);
+    if (!w.openFrameSource())
+        return 1;
+    if (parser.isSet(maxSkewOption))
+        w.setMaxSkew(parser.value(maxSkewOption).toDouble());
+    if (parser.isSet(forwardMappingOption))
+        w.setForwardMapping(true);
+    if (parser.isSet(remapToleranceOption))
+        w.setRemapTolerance(parser.value(remapToleranceOption).toInt());
+    w.setProcessingScale(processingScale);
+    if (parser.isSet(recordOption) && !w.startRecording(parser.value(recordOption), parser.isSet(recordMappingOption)))
+        return 1;
     w.show();
 
-    return a.exec();
+    return a->exec();
 }
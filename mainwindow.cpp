@@ -17,10 +17,10 @@
 
 */
 
-#include <Kinect.h>
-
 #include <QDebug>
 #include <QBoxLayout>
+#include <QFileDialog>
+#include <QActionGroup>
 
 #include "globals.h"
 #include "util.h"
@@ -29,6 +29,8 @@
 #include "rgbdwidget.h"
 #include "threedwidget.h"
 #include "irwidget.h"
+#include "framesource.h"
+#include "capturethread.h"
 #include "mainwindow.h"
 
 #include "ui_mainwindow.h"
@@ -37,33 +39,28 @@
 
 class MainWindowPrivate {
 public:
-  MainWindowPrivate(QWidget *parent = nullptr)
-    : kinectSensor(nullptr)
-    , depthFrameReader(nullptr)
-    , colorFrameReader(nullptr)
-    , irFrameReader(nullptr)
+  MainWindowPrivate(FrameSource *frameSource, QWidget *parent = nullptr)
+    : frameSource(frameSource)
+    , captureThread(nullptr)
     , depthWidget(nullptr)
     , videoWidget(nullptr)
     , rgbdWidget(nullptr)
     , threeDWidget(nullptr)
     , irWidget(nullptr)
-    , colorBuffer(new RGBQUAD[ColorSize])
+    , droppedFrameSets(0)
+    , discardedFrameSets(0)
   {
     Q_UNUSED(parent);
     // ...
   }
   ~MainWindowPrivate()
   {
-    if (kinectSensor)
-      kinectSensor->Close();
-    SafeRelease(kinectSensor);
-    SafeDelete(colorBuffer);
+    SafeDelete(captureThread);
+    SafeDelete(frameSource);
   }
 
-  IKinectSensor *kinectSensor;
-  IDepthFrameReader *depthFrameReader;
-  IColorFrameReader *colorFrameReader;
-  IInfraredFrameReader *irFrameReader;
+  FrameSource *frameSource;
+  CaptureThread *captureThread;
 
   DepthWidget *depthWidget;
   VideoWidget *videoWidget;
@@ -71,19 +68,21 @@ public:
   ThreeDWidget *threeDWidget;
   IRWidget *irWidget;
 
-  RGBQUAD *colorBuffer;
+  int droppedFrameSets;
+  int discardedFrameSets;
 };
 
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(FrameSource *frameSource, QWidget *parent)
   : QMainWindow(parent)
   , ui(new Ui::MainWindow)
-  , d_ptr(new MainWindowPrivate(this))
+  , d_ptr(new MainWindowPrivate(frameSource, this))
 {
   Q_D(MainWindow);
   ui->setupUi(this);
 
-  initKinect();
+  Q_ASSERT_X(d->frameSource != nullptr, "MainWindow::MainWindow()", "frame source must not be null");
+  d->captureThread = new CaptureThread(d->frameSource);
 
   d->depthWidget = new DepthWidget;
   d->rgbdWidget = new RGBDWidget;
@@ -104,14 +103,27 @@ MainWindow::MainWindow(QWidget *parent)
   ui->gridLayout->addLayout(vbox, 0, 0);
 
   QObject::connect(d->threeDWidget, SIGNAL(ready()), SLOT(initAfterGL()));
+  QObject::connect(d->threeDWidget, SIGNAL(frameRendered(FrameSet)), SLOT(processFrames(FrameSet)));
+  qRegisterMetaType<SensorCalibration>();
+  QObject::connect(d->captureThread, SIGNAL(calibrationAvailable(SensorCalibration)), d->threeDWidget, SLOT(setCalibration(SensorCalibration)));
 
   QObject::connect(ui->gammaDoubleSpinBox, SIGNAL(valueChanged(double)), SLOT(gammaChanged(double)));
   QObject::connect(ui->contrastDoubleSpinBox, SIGNAL(valueChanged(double)), SLOT(contrastChanged(double)));
   QObject::connect(ui->saturationDoubleSpinBox, SIGNAL(valueChanged(double)), SLOT(saturationChanged(double)));
+  QObject::connect(ui->actionRecordSession, SIGNAL(toggled(bool)), SLOT(toggleRecording(bool)));
   QObject::connect(ui->actionExit, SIGNAL(triggered(bool)),SLOT(close()));
+  QObject::connect(ui->actionShowGpuTimings, SIGNAL(toggled(bool)), d->threeDWidget, SLOT(setTimingOverlayVisible(bool)));
+  QActionGroup *processingResolutionGroup = new QActionGroup(this);
+  processingResolutionGroup->addAction(ui->actionProcessFullResolution);
+  processingResolutionGroup->addAction(ui->actionProcessHalfResolution);
+  processingResolutionGroup->addAction(ui->actionProcessQuarterResolution);
+  ui->actionProcessFullResolution->setData(1);
+  ui->actionProcessHalfResolution->setData(2);
+  ui->actionProcessQuarterResolution->setData(4);
+  QObject::connect(processingResolutionGroup, SIGNAL(triggered(QAction*)), SLOT(processingResolutionChanged(QAction*)));
   QObject::connect(ui->farVerticalSlider, SIGNAL(valueChanged(int)), SLOT(setFarThreshold(int)));
   QObject::connect(ui->nearVerticalSlider, SIGNAL(valueChanged(int)), SLOT(setNearThreshold(int)));
-  QObject::connect(ui->haloRadiusVerticalSlider, SIGNAL(valueChanged(int)), d->threeDWidget, SLOT(setHaloRadius(int)));
+  QObject::connect(ui->haloRadiusVerticalSlider, SIGNAL(valueChanged(int)), d->threeDWidget, SLOT(setHaloSize(int)));
   QObject::connect(d->rgbdWidget, SIGNAL(refPointsSet(QVector<QVector3D>)), d->threeDWidget, SLOT(setRefPoints(QVector<QVector3D>)));
 
   // showMaximized();
@@ -120,181 +132,119 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+  Q_D(MainWindow);
+  // the render thread takes from the capture thread, which is deleted before the widget
+  d->threeDWidget->stop();
   delete ui;
 }
 
 
-void MainWindow::initAfterGL(void)
+bool MainWindow::openFrameSource(void)
 {
-  // Q_D(MainWindow);
-  qDebug() << "MainWindow::initAfterGL()";
-  ui->actionMapFromColorToDepth->setChecked(true);
-  ui->actionMatchColorAndDepthSpace->setChecked(true);
-  ui->haloRadiusVerticalSlider->setValue(10);
-  ui->nearVerticalSlider->setValue(1589);
-  ui->farVerticalSlider->setValue(1903);
-  ui->saturationDoubleSpinBox->setValue(1.3);
-  ui->gammaDoubleSpinBox->setValue(1.4);
-  ui->contrastDoubleSpinBox->setValue(1.1);
-  startTimer(1000 / 25, Qt::PreciseTimer);
+  Q_D(MainWindow);
+  if (!d->frameSource->open()) {
+    qWarning() << "MainWindow: cannot open the frame source";
+    return false;
+  }
+  return true;
 }
 
 
-void MainWindow::timerEvent(QTimerEvent*)
+bool MainWindow::startRecording(const QString &fileName, bool recordMapping)
 {
   Q_D(MainWindow);
-  bool depthReady = false;
-  bool rgbReady = false;
-  bool irReady = false;
-  INT64 timestamp = 0;
-  UINT16 *depthBuffer = nullptr;
-  UINT16 *irBuffer = nullptr;
-  USHORT minDistance = 0;
-  USHORT maxDistance = 0;
-  int width = 0;
-  int weight = 0;
-  UINT bufferSize = 0;
-
-  IDepthFrame *depthFrame = nullptr;
-  if (d->depthFrameReader != nullptr) {
-    HRESULT hr = d->depthFrameReader->AcquireLatestFrame(&depthFrame);
-    if (SUCCEEDED(hr)) {
-      IFrameDescription *depthFrameDescription = nullptr;
-      hr = depthFrame->get_RelativeTime(&timestamp);
-      if (SUCCEEDED(hr))
-        hr = depthFrame->get_FrameDescription(&depthFrameDescription);
-      if (SUCCEEDED(hr))
-        hr = depthFrameDescription->get_Width(&width);
-      if (SUCCEEDED(hr))
-        hr = depthFrameDescription->get_Height(&weight);
-      if (SUCCEEDED(hr))
-        hr = depthFrame->get_DepthMinReliableDistance(&minDistance);
-      if (SUCCEEDED(hr)) {
-        maxDistance = USHRT_MAX;
-        hr = depthFrame->get_DepthMaxReliableDistance(&maxDistance);
-      }
-      if (SUCCEEDED(hr))
-        hr = depthFrame->AccessUnderlyingBuffer(&bufferSize, &depthBuffer);
-      if (SUCCEEDED(hr)) {
-        d->depthWidget->setDepthData(timestamp, depthBuffer, width, weight, minDistance, maxDistance);
-        d->rgbdWidget->setDepthData(timestamp, depthBuffer, width, weight, minDistance, maxDistance);
-        depthReady = true;
-      }
-      SafeRelease(depthFrameDescription);
-    }
-  }
+  const bool ok = !fileName.isEmpty() && d->captureThread->startRecording(fileName, recordMapping);
+  ui->actionRecordSession->blockSignals(true);
+  ui->actionRecordSession->setChecked(ok);
+  ui->actionRecordSession->blockSignals(false);
+  return ok;
+}
+
+
+void MainWindow::setMaxSkew(double ms)
+{
+  Q_D(MainWindow);
+  d->captureThread->setSkewTolerance(INT64(ms * 1e4));
+}
+
+
+void MainWindow::setForwardMapping(bool enabled)
+{
+  Q_D(MainWindow);
+  d->captureThread->setColorMapping(!enabled);
+  d->threeDWidget->setForwardMapping(enabled);
+}
 
-  IInfraredFrame *irFrame = nullptr;
-  if (d->irFrameReader != nullptr) {
-    HRESULT hr = d->irFrameReader->AcquireLatestFrame(&irFrame);
-    if (SUCCEEDED(hr)) {
-      IFrameDescription *irFrameDescription = nullptr;
-      hr = irFrame->get_RelativeTime(&timestamp);
-      if (SUCCEEDED(hr))
-        hr = irFrame->get_FrameDescription(&irFrameDescription);
-      if (SUCCEEDED(hr))
-        hr = irFrameDescription->get_Width(&width);
-      if (SUCCEEDED(hr))
-        hr = irFrameDescription->get_Height(&weight);
-      if (SUCCEEDED(hr))
-        hr = irFrame->AccessUnderlyingBuffer(&bufferSize, &irBuffer);
-      if (SUCCEEDED(hr)) {
-        d->irWidget->setIRData(timestamp, irBuffer, width, weight);
-        irReady = true;
-      }
-      SafeRelease(irFrameDescription);
-    }
-  }
 
-  IColorFrame* colorFrame = nullptr;
-  if (d->colorFrameReader != nullptr) {
-    HRESULT hr = d->colorFrameReader->AcquireLatestFrame(&colorFrame);
-    if (SUCCEEDED(hr)) {
-      IFrameDescription *colorFrameDescription = nullptr;
-      ColorImageFormat imageFormat = ColorImageFormat_None;
-      hr = colorFrame->get_RelativeTime(&timestamp);
-      if (SUCCEEDED(hr))
-        hr = colorFrame->get_FrameDescription(&colorFrameDescription);
-      qDebug() << colorFrameDescription;
-      if (SUCCEEDED(hr))
-        hr = colorFrameDescription->get_Width(&width);
-      if (SUCCEEDED(hr))
-        hr = colorFrameDescription->get_Height(&weight);
-      if (SUCCEEDED(hr))
-        hr = colorFrame->get_RawColorImageFormat(&imageFormat);
-      if (SUCCEEDED(hr)) {
-        if (imageFormat == ColorImageFormat_Bgra) {
-          hr = colorFrame->AccessRawUnderlyingBuffer(&bufferSize, reinterpret_cast<BYTE**>(&d->colorBuffer));
-        }
-        else if (d->colorBuffer != nullptr) { // regular case: imageFormat == ColorImageFormat_Yuy2
-          bufferSize = ColorSize * sizeof(RGBQUAD);
-          hr = colorFrame->CopyConvertedFrameDataToArray(bufferSize, reinterpret_cast<BYTE*>(d->colorBuffer), ColorImageFormat_Bgra);
-        }
-        else {
-          hr = E_FAIL;
-        }
-      }
-      if (SUCCEEDED(hr)) {
-        d->videoWidget->setVideoData(timestamp, reinterpret_cast<const QRgb*>(d->colorBuffer), width, weight);
-        d->rgbdWidget->setColorData(timestamp, reinterpret_cast<const QRgb*>(d->colorBuffer), width, weight);
-        rgbReady = true;
-      }
-      SafeRelease(colorFrameDescription);
-    }
+void MainWindow::setProcessingScale(int divisor)
+{
+  Q_D(MainWindow);
+  foreach (QAction *action, ui->menuProcessingResolution->actions()) {
+    if (action->data().toInt() == divisor)
+      action->setChecked(true);
   }
+  d->threeDWidget->setProcessingScale(divisor);
+}
 
-  if (rgbReady && depthReady && irReady)
-    d->threeDWidget->process(timestamp, reinterpret_cast<const uchar*>(d->colorBuffer), depthBuffer, minDistance, maxDistance);
 
-  SafeRelease(depthFrame);
-  SafeRelease(colorFrame);
-  SafeRelease(irFrame);
+void MainWindow::processingResolutionChanged(QAction *action)
+{
+  setProcessingScale(action->data().toInt());
 }
 
 
-bool MainWindow::initKinect(void)
+void MainWindow::setRemapTolerance(int mm)
 {
   Q_D(MainWindow);
+  d->captureThread->setRemapTolerance(mm);
+}
 
-  qDebug() << "MainWindow::initKinect()";
 
-  HRESULT hr;
+void MainWindow::toggleRecording(bool enabled)
+{
+  Q_D(MainWindow);
+  if (enabled)
+    startRecording(QFileDialog::getSaveFileName(this, tr("Record session"), QString(), tr("W-1 sessions (*.w1r)")));
+  else
+    d->captureThread->stopRecording();
+}
 
-  hr = GetDefaultKinectSensor(&d->kinectSensor);
-  if (FAILED(hr))
-    return false;
 
-  if (d->kinectSensor != nullptr) {
-    IDepthFrameSource *pDepthFrameSource = nullptr;
-    hr = d->kinectSensor->Open();
-
-    if (SUCCEEDED(hr))
-      hr = d->kinectSensor->get_DepthFrameSource(&pDepthFrameSource);
-    if (SUCCEEDED(hr))
-      hr = pDepthFrameSource->OpenReader(&d->depthFrameReader);
-    SafeRelease(pDepthFrameSource);
-
-    IColorFrameSource *pColorFrameSource = nullptr;
-    if (SUCCEEDED(hr))
-      hr = d->kinectSensor->get_ColorFrameSource(&pColorFrameSource);
-    if (SUCCEEDED(hr))
-      hr = pColorFrameSource->OpenReader(&d->colorFrameReader);
-    SafeRelease(pColorFrameSource);
-
-    IInfraredFrameSource *pIRFrameSource = nullptr;
-    if (SUCCEEDED(hr))
-      hr = d->kinectSensor->get_InfraredFrameSource(&pIRFrameSource);
-    if (SUCCEEDED(hr))
-      hr = pIRFrameSource->OpenReader(&d->irFrameReader);
-    SafeRelease(pIRFrameSource);
-  }
+void MainWindow::initAfterGL(void)
+{
+  Q_D(MainWindow);
+  qDebug() << "MainWindow::initAfterGL()";
+  ui->actionMapFromColorToDepth->setChecked(true);
+  ui->actionMatchColorAndDepthSpace->setChecked(true);
+  ui->haloRadiusVerticalSlider->setValue(DefaultHaloSize);
+  ui->nearVerticalSlider->setValue(DefaultNearThreshold);
+  ui->farVerticalSlider->setValue(DefaultFarThreshold);
+  ui->saturationDoubleSpinBox->setValue(DefaultSaturation);
+  ui->gammaDoubleSpinBox->setValue(DefaultGamma);
+  ui->contrastDoubleSpinBox->setValue(DefaultContrast);
+  d->threeDWidget->start(d->captureThread);
+  d->captureThread->start(QThread::TimeCriticalPriority);
+}
 
-  if (!d->kinectSensor || FAILED(hr)) {
-    qWarning() << "No ready Kinect found!";
-    return false;
-  }
 
-  return true;
+void MainWindow::processFrames(const FrameSet &frameSet)
+{
+  Q_D(MainWindow);
+  d->depthWidget->setDepthFrame(frameSet.depth);
+  d->rgbdWidget->setDepthFrame(frameSet.depth);
+  d->rgbdWidget->setMappingFrame(frameSet.mapping);
+  d->irWidget->setIRFrame(frameSet.ir);
+  // both render on worker threads and update themselves when they're done
+  d->videoWidget->setColorFrame(frameSet.color);
+  d->rgbdWidget->setColorFrame(frameSet.color);
+
+  const int dropped = d->captureThread->droppedFrameSets();
+  const int discarded = d->captureThread->discardedFrameSets();
+  if (dropped != d->droppedFrameSets || discarded != d->discardedFrameSets) {
+    d->droppedFrameSets = dropped;
+    d->discardedFrameSets = discarded;
+    ui->statusBar->showMessage(tr("%1 frame sets dropped, %2 without matching timestamps discarded").arg(dropped).arg(discarded));
+  }
 }
 
 
@@ -22,29 +22,35 @@
 
 #include <QMainWindow>
 #include <QScopedPointer>
-#include <QTimerEvent>
 #include <QVector>
 #include <QVector3D>
 
+#include "frameset.h"
+
 namespace Ui {
 class MainWindow;
 }
 
 class MainWindowPrivate;
+class FrameSource;
+class QAction;
 
 class MainWindow : public QMainWindow
 {
   Q_OBJECT
 
 public:
-  explicit MainWindow(QWidget *parent = nullptr);
+  explicit MainWindow(FrameSource *frameSource, QWidget *parent = nullptr);
   ~MainWindow();
 
-protected:
-  virtual void timerEvent(QTimerEvent*);
-
-private: // methods
-  bool initKinect(void);
+  // must succeed before the window is shown, which starts the capture
+  bool openFrameSource(void);
+  bool startRecording(const QString &fileName, bool recordMapping = false);
+  void setMaxSkew(double ms);
+  void setForwardMapping(bool enabled);
+  // 1, 2 or 4, see FrameRenderer::setProcessingScale()
+  void setProcessingScale(int divisor);
+  void setRemapTolerance(int mm);
 
 private slots:
   void contrastChanged(double);
@@ -53,6 +59,9 @@ private slots:
   void setNearThreshold(int);
   void setFarThreshold(int);
   void initAfterGL(void);
+  void processFrames(const FrameSet&);
+  void toggleRecording(bool);
+  void processingResolutionChanged(QAction*);
 
 private:
   Ui::MainWindow *ui;
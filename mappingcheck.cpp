@@ -0,0 +1,95 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "sessionreader.h"
+#include "coordinatemapper.h"
+#include "mappingcheck.h"
+
+#include <cstdlib>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QVector>
+
+
+int verifyMapping(const QString &sessionFileName)
+{
+  SessionReader reader(sessionFileName);
+  if (!reader.open())
+    return EXIT_FAILURE;
+  SensorCalibration calibration;
+  if (!reader.calibration(calibration)) {
+    qWarning() << sessionFileName << "doesn't contain the sensor calibration.";
+    return EXIT_FAILURE;
+  }
+  CoordinateMapper mapper(calibration);
+  QVector<DSP> native(ColorSize);
+  qint64 frames = 0;
+  qint64 nsecs = 0;
+  qint64 bothValid = 0;
+  qint64 exact = 0;
+  qint64 withinOne = 0;
+  qint64 onlyRecordedValid = 0;
+  qint64 onlyNativeValid = 0;
+  for (int frame = 0; frame < reader.frameCount(); ++frame) {
+    const SessionFrameHeader *header = reader.frameHeader(frame);
+    const SessionStreamInfo &info = header->streams[SessionMappingStream];
+    const UINT16 *depth = reinterpret_cast<const UINT16*>(reader.streamData(frame, SessionDepthStream));
+    const DSP *recorded = reinterpret_cast<const DSP*>(reader.streamData(frame, SessionMappingStream));
+    if (depth == nullptr || recorded == nullptr || info.format != SessionMappingDsp || info.size != ColorSize * sizeof(DSP))
+      continue;
+    QElapsedTimer t;
+    t.start();
+    mapper.mapColorFrameToDepthSpace(depth, native.data());
+    nsecs += t.nsecsElapsed();
+    ++frames;
+    for (int i = 0; i < ColorSize; ++i) {
+      const bool recordedValid = recorded[i].x >= 0;
+      const bool nativeValid = native.at(i).x >= 0;
+      if (recordedValid && nativeValid) {
+        ++bothValid;
+        const int dx = qAbs(recorded[i].x - native.at(i).x);
+        const int dy = qAbs(recorded[i].y - native.at(i).y);
+        if (dx == 0 && dy == 0)
+          ++exact;
+        if (dx <= 1 && dy <= 1)
+          ++withinOne;
+      }
+      else if (recordedValid) {
+        ++onlyRecordedValid;
+      }
+      else if (nativeValid) {
+        ++onlyNativeValid;
+      }
+    }
+  }
+  if (frames == 0) {
+    qWarning() << sessionFileName << "wasn't recorded with --record-mapping.";
+    return EXIT_FAILURE;
+  }
+  const double pixels = double(frames) * ColorSize;
+  qDebug() << "Compared" << frames << "frames, native mapping took" << 1e-6 * nsecs / frames << "ms per frame on average";
+  qDebug() << "valid in both:" << 100.0 * bothValid / pixels << "%,"
+           << "identical:" << 100.0 * exact / qMax(bothValid, qint64(1)) << "%,"
+           << "at most 1 px apart:" << 100.0 * withinOne / qMax(bothValid, qint64(1)) << "%";
+  qDebug() << "valid in the recording only:" << 100.0 * onlyRecordedValid / pixels << "%,"
+           << "valid in the native mapping only:" << 100.0 * onlyNativeValid / pixels << "%";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __MAPPINGCHECK_H_
+#define __MAPPINGCHECK_H_
+
+#include <QString>
+
+// Maps every frame of a session recorded with --record-mapping natively
+// from the recorded calibration and compares the result with the SDK's
+// mapping recorded alongside. Prints the statistics and returns the
+// process exit code.
+int verifyMapping(const QString &sessionFileName);
+
+#endif // __MAPPINGCHECK_H_
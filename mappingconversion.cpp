@@ -0,0 +1,139 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "simd.h"
+#include "mappingconversion.h"
+
+#include <cstdint>
+#include <limits>
+
+
+static void depthSpacePointsToDspScalar(const DepthSpacePoint *src, DSP *dst, int count)
+{
+  const DepthSpacePoint *const srcEnd = src + count;
+  while (src < srcEnd) {
+    if (src->X == -std::numeric_limits<float>::infinity() || src->Y == -std::numeric_limits<float>::infinity()) {
+      dst->x = -1;
+      dst->y = -1;
+    }
+    else {
+      dst->x = INT16(src->X + .5f);
+      dst->y = INT16(src->Y + .5f);
+    }
+    ++dst;
+    ++src;
+  }
+}
+
+
+#ifdef W1_X86
+
+// The vector kernels truncate x + .5 like the scalar cast does. A lane
+// that compares equal to -infinity is all ones, i.e. -1, after OR-ing
+// it into the converted lane; swapping the X and Y lanes of the mask
+// first invalidates both coordinates of a point. packs then narrows
+// the 32 bit lanes to INT16.
+
+static int pointsToAlignment(const DSP *dst, int alignment)
+{
+  return int(((alignment - (reinterpret_cast<uintptr_t>(dst) & (alignment - 1))) & (alignment - 1)) / sizeof(DSP));
+}
+
+
+static inline __m128i convertSse2(__m128 xy, __m128 half, __m128 invalid)
+{
+  __m128 mask = _mm_cmpeq_ps(xy, invalid);
+  mask = _mm_or_ps(mask, _mm_shuffle_ps(mask, mask, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_or_si128(_mm_cvttps_epi32(_mm_add_ps(xy, half)), _mm_castps_si128(mask));
+}
+
+
+static void depthSpacePointsToDspSse2(const DepthSpacePoint *src, DSP *dst, int count)
+{
+  const int head = qMin(count, pointsToAlignment(dst, 16));
+  depthSpacePointsToDspScalar(src, dst, head);
+  src += head;
+  dst += head;
+  count -= head;
+  const __m128 half = _mm_set1_ps(.5f);
+  const __m128 invalid = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+  const int vectorCount = count & ~3;
+  const float *s = reinterpret_cast<const float*>(src);
+  __m128i *d = reinterpret_cast<__m128i*>(dst);
+  for (int i = 0; i < vectorCount; i += 4) {
+    const __m128i p01 = convertSse2(_mm_loadu_ps(s), half, invalid);
+    const __m128i p23 = convertSse2(_mm_loadu_ps(s + 4), half, invalid);
+    _mm_stream_si128(d, _mm_packs_epi32(p01, p23));
+    s += 8;
+    ++d;
+  }
+  _mm_sfence();
+  depthSpacePointsToDspScalar(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+
+W1_TARGET_AVX2
+static inline __m256i convertAvx2(__m256 xy, __m256 half, __m256 invalid)
+{
+  __m256 mask = _mm256_cmp_ps(xy, invalid, _CMP_EQ_OQ);
+  mask = _mm256_or_ps(mask, _mm256_permute_ps(mask, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm256_or_si256(_mm256_cvttps_epi32(_mm256_add_ps(xy, half)), _mm256_castps_si256(mask));
+}
+
+
+W1_TARGET_AVX2
+static void depthSpacePointsToDspAvx2(const DepthSpacePoint *src, DSP *dst, int count)
+{
+  const int head = qMin(count, pointsToAlignment(dst, 32));
+  depthSpacePointsToDspScalar(src, dst, head);
+  src += head;
+  dst += head;
+  count -= head;
+  const __m256 half = _mm256_set1_ps(.5f);
+  const __m256 invalid = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  const int vectorCount = count & ~7;
+  const float *s = reinterpret_cast<const float*>(src);
+  __m256i *d = reinterpret_cast<__m256i*>(dst);
+  for (int i = 0; i < vectorCount; i += 8) {
+    const __m256i p0123 = convertAvx2(_mm256_loadu_ps(s), half, invalid);
+    const __m256i p4567 = convertAvx2(_mm256_loadu_ps(s + 8), half, invalid);
+    // packs works per 128 bit lane and yields points 0 1 4 5 2 3 6 7
+    const __m256i packed = _mm256_packs_epi32(p0123, p4567);
+    _mm256_stream_si256(d, _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    s += 16;
+    ++d;
+  }
+  _mm_sfence();
+  depthSpacePointsToDspScalar(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+#endif // W1_X86
+
+
+void depthSpacePointsToDsp(const DepthSpacePoint *src, DSP *dst, int count)
+{
+#ifdef W1_X86
+  if (cpuSupportsAvx2())
+    depthSpacePointsToDspAvx2(src, dst, count);
+  else
+    depthSpacePointsToDspSse2(src, dst, count);
+#else
+  depthSpacePointsToDspScalar(src, dst, count);
+#endif
+}
@@ -0,0 +1,32 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __MAPPINGCONVERSION_H_
+#define __MAPPINGCONVERSION_H_
+
+#include "frameset.h"
+
+// Rounds depth space points to DSPs; points with an infinite coordinate,
+// which the Kinect SDK reports for unmappable color pixels, become -1.
+// Writes dst with non-temporal stores, so that the 8 MB of a color
+// frame don't evict what's in the caches. Uses AVX2 or SSE2 if
+// available; safe to call from any thread.
+void depthSpacePointsToDsp(const DepthSpacePoint *src, DSP *dst, int count);
+
+#endif // __MAPPINGCONVERSION_H_
@@ -0,0 +1,51 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __REMOVALENGINE_H_
+#define __REMOVALENGINE_H_
+
+#include <QImage>
+
+#include "frameset.h"
+
+
+// Removes what is in front of the board: renders the color pixels
+// whose depth, and that of their halo, lies between the thresholds,
+// and lets the previous image shine through everywhere else.
+class RemovalEngine
+{
+public:
+  virtual ~RemovalEngine() { /* ... */ }
+
+  virtual void process(const FrameSet&) = 0;
+  // renders the last processed frame set into an image
+  virtual void renderImage(void) = 0;
+  // the last rendered image, top row first
+  virtual QImage image(void) = 0;
+
+  // the settings take effect with the next renderImage()
+  virtual void setContrast(float) = 0;
+  virtual void setSaturation(float) = 0;
+  virtual void setGamma(float) = 0;
+  virtual void setNearThreshold(float) = 0;
+  virtual void setFarThreshold(float) = 0;
+  virtual void setHaloSize(int) = 0;
+};
+
+#endif // __REMOVALENGINE_H_
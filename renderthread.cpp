@@ -0,0 +1,380 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "util.h"
+#include "globals.h"
+#include "renderthread.h"
+#include "capturethread.h"
+#include "framerenderer.h"
+#include "triplebuffer.h"
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOffscreenSurface>
+#include <QSemaphore>
+#include <QMutex>
+#include <QMutexLocker>
+
+
+RenderParameters::RenderParameters(void)
+  : contrast(float(DefaultContrast))
+  , saturation(float(DefaultSaturation))
+  , gamma(float(DefaultGamma))
+  , nearThreshold(float(DefaultNearThreshold))
+  , farThreshold(float(DefaultFarThreshold))
+  , haloSize(DefaultHaloSize)
+  , processingScale(1)
+{
+  // ...
+}
+
+
+class RenderThreadPrivate {
+public:
+  RenderThreadPrivate(CaptureThread *captureThread)
+    : captureThread(captureThread)
+    , context(nullptr)
+    , surface(nullptr)
+    , renderer(nullptr)
+    , forwardMapping(false)
+    , parametersApplied(false)
+    , hasImage(false)
+    , calibrationPending(false)
+    , imageTexture(0)
+    , imageFence(nullptr)
+    , presentedTexture(0)
+    , stopped(false)
+  { /* ... */ }
+  ~RenderThreadPrivate()
+  {
+    SafeDelete(context);
+    SafeDelete(surface);
+  }
+
+  CaptureThread *captureThread;
+  QOpenGLContext *context;
+  QOffscreenSurface *surface;
+  // created, used and deleted on the render thread only
+  FrameRenderer *renderer;
+  bool forwardMapping;
+  // released for every notification of the capture thread and every
+  // new set of parameters
+  QSemaphore wakeups;
+
+  // written by the GUI, picked up before each image
+  TripleBuffer<RenderParameters> parameters;
+  RenderParameters appliedParameters;
+  bool parametersApplied;
+  bool hasImage;
+
+  // guards everything below
+  mutable QMutex mutex;
+  SensorCalibration calibration;
+  bool calibrationPending;
+  // the image waiting to be taken, 0 if there's none
+  GLuint imageTexture;
+  GLsync imageFence;
+  FrameSet imageFrameSet;
+  // the image the GUI draws, and the fences of the ones it gave back
+  GLuint presentedTexture;
+  QVector<GLsync> releaseFences;
+  bool stopped;
+  QVector<GpuTimer::Timing> timings;
+};
+
+
+RenderThread::RenderThread(CaptureThread *captureThread, QOpenGLContext *shareContext, QObject *parent)
+  : QThread(parent)
+  , d_ptr(new RenderThreadPrivate(captureThread))
+{
+  Q_D(RenderThread);
+  Q_ASSERT_X(captureThread != nullptr, "RenderThread::RenderThread()", "capture thread must not be null");
+  d->context = new QOpenGLContext;
+  d->context->setFormat(FrameRenderer::surfaceFormat());
+  d->context->setShareContext(shareContext);
+  if (!d->context->create())
+    qWarning() << "RenderThread: cannot create an OpenGL context";
+  // offscreen surfaces must be created on the GUI thread
+  d->surface = new QOffscreenSurface;
+  d->surface->setFormat(d->context->format());
+  d->surface->create();
+  d->context->moveToThread(this);
+  // the capture thread's notifications mustn't take the detour via the GUI thread
+  QObject::connect(captureThread, SIGNAL(framesAvailable()), this, SLOT(wake()), Qt::DirectConnection);
+}
+
+
+RenderThread::~RenderThread()
+{
+  stop();
+}
+
+
+void RenderThread::stop(void)
+{
+  Q_D(RenderThread);
+  requestInterruption();
+  d->wakeups.release();
+  wait();
+}
+
+
+void RenderThread::wake(void)
+{
+  Q_D(RenderThread);
+  d->wakeups.release();
+}
+
+
+void RenderThread::setForwardMapping(bool enabled)
+{
+  Q_D(RenderThread);
+  Q_ASSERT_X(!isRunning(), "RenderThread::setForwardMapping()", "must be called before start()");
+  d->forwardMapping = enabled;
+}
+
+
+void RenderThread::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(RenderThread);
+  QMutexLocker lock(&d->mutex);
+  d->calibration = calibration;
+  d->calibrationPending = true;
+}
+
+
+void RenderThread::setParameters(const RenderParameters &parameters)
+{
+  Q_D(RenderThread);
+  d->parameters.back() = parameters;
+  d->parameters.publish();
+  d->wakeups.release();
+}
+
+
+bool RenderThread::hasImage(void) const
+{
+  Q_D(const RenderThread);
+  QMutexLocker lock(&d->mutex);
+  return d->imageTexture != 0;
+}
+
+
+GLuint RenderThread::takeImage(GLsync *fence, FrameSet *frameSet)
+{
+  Q_D(RenderThread);
+  QMutexLocker lock(&d->mutex);
+  const GLuint texture = d->imageTexture;
+  if (texture != 0) {
+    Q_ASSERT_X(d->presentedTexture == 0, "RenderThread::takeImage()", "the image taken before must be released first");
+    d->presentedTexture = texture;
+  }
+  *fence = d->imageFence;
+  *frameSet = std::move(d->imageFrameSet);
+  d->imageTexture = 0;
+  d->imageFence = nullptr;
+  d->imageFrameSet.reset();
+  return texture;
+}
+
+
+void RenderThread::releaseImage(GLuint texture, GLsync fence)
+{
+  Q_D(RenderThread);
+  QMutexLocker lock(&d->mutex);
+  Q_ASSERT_X(texture == d->presentedTexture, "RenderThread::releaseImage()", "texture must be the one taken last");
+  d->presentedTexture = 0;
+  if (!d->stopped) {
+    d->releaseFences.append(fence);
+  }
+  else {
+    // the render thread won't pick it up anymore; the caller's context is current
+    QOpenGLContext::currentContext()->extraFunctions()->glDeleteSync(fence);
+  }
+}
+
+
+QVector<GpuTimer::Timing> RenderThread::timings(void) const
+{
+  Q_D(const RenderThread);
+  QMutexLocker lock(&d->mutex);
+  return d->timings;
+}
+
+
+void RenderThread::run(void)
+{
+  Q_D(RenderThread);
+  if (!d->context->makeCurrent(d->surface)) {
+    qWarning() << "RenderThread: cannot make the OpenGL context current";
+    return;
+  }
+  d->renderer = new FrameRenderer;
+  d->renderer->setForwardMapping(d->forwardMapping);
+  d->renderer->initialize();
+
+  bool busy = false;
+  while (!isInterruptionRequested()) {
+    // after a frame set the next one may already be waiting, and it
+    // wouldn't raise a notification by itself
+    if (!busy)
+      d->wakeups.acquire();
+    d->wakeups.tryAcquire(d->wakeups.available());
+    if (isInterruptionRequested())
+      break;
+    SensorCalibration calibration;
+    bool calibrationPending;
+    {
+      QMutexLocker lock(&d->mutex);
+      calibration = d->calibration;
+      calibrationPending = d->calibrationPending;
+      d->calibrationPending = false;
+    }
+    if (calibrationPending)
+      d->renderer->setCalibration(calibration);
+    const bool parametersChanged = applyParameters();
+    const FrameSet &frameSet = d->captureThread->takeLatestFrameSet();
+    busy = !frameSet.isNull();
+    if (busy) {
+      d->renderer->process(frameSet);
+    }
+    else if (!parametersChanged || !d->hasImage) {
+      continue;
+    }
+    waitForPresenter();
+    // new settings show on the last frame set until the next one arrives
+    d->renderer->renderImage();
+    d->hasImage = true;
+    publishImage(frameSet);
+  }
+
+  {
+    QMutexLocker lock(&d->mutex);
+    QOpenGLExtraFunctions *f = d->context->extraFunctions();
+    if (d->imageFence != nullptr)
+      f->glDeleteSync(d->imageFence);
+    d->imageFence = nullptr;
+    d->imageTexture = 0;
+    d->imageFrameSet.reset();
+    foreach (GLsync fence, d->releaseFences)
+      f->glDeleteSync(fence);
+    d->releaseFences.clear();
+    d->stopped = true;
+  }
+  // the renderer releases its GL resources
+  SafeDelete(d->renderer);
+  d->context->doneCurrent();
+  d->context->moveToThread(QCoreApplication::instance()->thread());
+}
+
+
+// Passes the settings that changed since the last image on to the
+// renderer, which collects them until it renders; setHaloSize() and
+// the shader variants aren't free. Returns whether anything changed.
+bool RenderThread::applyParameters(void)
+{
+  Q_D(RenderThread);
+  if (!d->parameters.update())
+    return false;
+  const RenderParameters &p = d->parameters.front();
+  const RenderParameters &q = d->appliedParameters;
+  const bool all = !d->parametersApplied;
+  int changes = 0;
+  if (all || p.contrast != q.contrast) {
+    d->renderer->setContrast(p.contrast);
+    ++changes;
+  }
+  if (all || p.saturation != q.saturation) {
+    d->renderer->setSaturation(p.saturation);
+    ++changes;
+  }
+  if (all || p.gamma != q.gamma) {
+    d->renderer->setGamma(p.gamma);
+    ++changes;
+  }
+  if (all || p.nearThreshold != q.nearThreshold) {
+    d->renderer->setNearThreshold(p.nearThreshold);
+    ++changes;
+  }
+  if (all || p.farThreshold != q.farThreshold) {
+    d->renderer->setFarThreshold(p.farThreshold);
+    ++changes;
+  }
+  if (all || p.haloSize != q.haloSize) {
+    d->renderer->setHaloSize(p.haloSize);
+    ++changes;
+  }
+  if (all || p.processingScale != q.processingScale) {
+    d->renderer->setProcessingScale(p.processingScale);
+    ++changes;
+  }
+  d->appliedParameters = p;
+  d->parametersApplied = true;
+  return changes > 0;
+}
+
+
+// Keeps the renderer off the image the GUI draws. The images it gave
+// back may still be read by commands the GPU hasn't got to yet, so
+// the next image waits for them there.
+void RenderThread::waitForPresenter(void)
+{
+  Q_D(RenderThread);
+  QVector<GLsync> releaseFences;
+  {
+    QMutexLocker lock(&d->mutex);
+    d->renderer->setPresentedTexture(d->presentedTexture);
+    releaseFences.swap(d->releaseFences);
+  }
+  QOpenGLExtraFunctions *f = d->context->extraFunctions();
+  foreach (GLsync fence, releaseFences) {
+    f->glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+    f->glDeleteSync(fence);
+  }
+}
+
+
+// Hands the image just rendered over to the GUI. The fence lets the
+// other context wait for it on the GPU instead of this thread waiting
+// with glFinish(); it has to be flushed to be seen there. An image
+// that wasn't taken is replaced.
+void RenderThread::publishImage(const FrameSet &frameSet)
+{
+  Q_D(RenderThread);
+  QOpenGLExtraFunctions *f = d->context->extraFunctions();
+  GLsync fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  f->glFlush();
+  bool wasPending;
+  {
+    QMutexLocker lock(&d->mutex);
+    wasPending = d->imageTexture != 0;
+    if (d->imageFence != nullptr)
+      f->glDeleteSync(d->imageFence);
+    d->imageTexture = d->renderer->imageTexture();
+    d->imageFence = fence;
+    // an image of the same frame set with new settings keeps the set that is waiting
+    if (!frameSet.isNull())
+      d->imageFrameSet = frameSet;
+    d->timings = d->renderer->timings();
+  }
+  if (!wasPending)
+    emit imageAvailable();
+}
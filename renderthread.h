@@ -0,0 +1,113 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __RENDERTHREAD_H_
+#define __RENDERTHREAD_H_
+
+#include <QThread>
+#include <QScopedPointer>
+#include <QVector>
+#include <qopengl.h>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+#include "gputimer.h"
+
+class CaptureThread;
+class QOpenGLContext;
+class RenderThreadPrivate;
+
+// The settings of the removal the GUI can change while it's running.
+struct RenderParameters {
+  RenderParameters(void);
+
+  float contrast;
+  float saturation;
+  float gamma;
+  float nearThreshold;
+  float farThreshold;
+  int haloSize;
+  // see FrameRenderer::setProcessingScale()
+  int processingScale;
+};
+
+
+// Runs a FrameRenderer in an OpenGL context of its own on a thread of
+// its own, so that uploading and removing neither waits for the GUI
+// nor makes it wait. It takes the frame sets straight from the capture
+// thread and renders each of them into a texture which is shared with
+// the context the thread was created for.
+class RenderThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  // shareContext is the context the images are drawn in later on
+  RenderThread(CaptureThread *captureThread, QOpenGLContext *shareContext, QObject *parent = nullptr);
+  ~RenderThread();
+
+  void stop(void);
+
+  // must be called before start()
+  void setForwardMapping(bool enabled);
+  // may be called any time, it's passed on before the next frame set
+  void setCalibration(const SensorCalibration&);
+  // publishes the settings to be used from the next image on; the last
+  // frame set is rendered again with them. Must always be called from
+  // the same thread, and not more often than images are needed.
+  void setParameters(const RenderParameters&);
+
+  // whether there's a new image since the last call of takeImage()
+  bool hasImage(void) const;
+  // returns the texture holding the latest image, or 0 if there's no
+  // new one since the last call. frameSet is null if the image only
+  // shows new settings. The caller's context has to wait for the fence
+  // before sampling it and delete it afterwards. The texture isn't
+  // rendered into until it's given back with releaseImage(), which has
+  // to be done before the next image is taken.
+  GLuint takeImage(GLsync *fence, FrameSet *frameSet);
+  // gives the texture from takeImage() back. The fence has to follow
+  // the caller's last use of it and be flushed; it's waited for on the
+  // GPU before rendering into the texture again, and deleted here.
+  void releaseImage(GLuint texture, GLsync fence);
+
+  // see FrameRenderer::timings()
+  QVector<GpuTimer::Timing> timings(void) const;
+
+signals:
+  // emitted when an image is waiting to be taken
+  void imageAvailable(void);
+
+protected:
+  virtual void run(void);
+
+private slots:
+  void wake(void);
+
+private:
+  QScopedPointer<RenderThreadPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(RenderThread)
+  Q_DISABLE_COPY(RenderThread)
+
+  bool applyParameters(void);
+  void waitForPresenter(void);
+  void publishImage(const FrameSet&);
+};
+
+#endif // __RENDERTHREAD_H_
@@ -0,0 +1,284 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "sessionreader.h"
+#include "replayframesource.h"
+
+#include <cstring>
+#include <limits>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QThread>
+
+
+class ReplayFrameSourcePrivate {
+public:
+  enum Streams {
+    NoStream = 0,
+    DepthStream = 0x1,
+    ColorStream = 0x2,
+    IRStream = 0x4,
+    AllStreams = DepthStream | ColorStream | IRStream
+  };
+
+  ReplayFrameSourcePrivate(const QString &fileName, bool fullSpeed)
+    : reader(fileName)
+    , fullSpeed(fullSpeed)
+    , currentFrame(-1)
+    , mappingFrame(-1)
+    , streamsAcquired(AllStreams)
+    , hasCalibration(false)
+  { /* ... */ }
+
+  bool streamAvailable(Streams stream, SessionStream sessionStream, quint64 size);
+  const DSP *recordedMapping(int frame) const;
+
+  SessionReader reader;
+  bool fullSpeed;
+  QElapsedTimer clock;
+  INT64 firstTimestamp;
+  int currentFrame;
+  // the frame whose depth data was handed out last, read by other threads
+  QAtomicInt mappingFrame;
+  int streamsAcquired;
+  SensorCalibration calibration;
+  bool hasCalibration;
+};
+
+
+bool ReplayFrameSourcePrivate::streamAvailable(Streams stream, SessionStream sessionStream, quint64 size)
+{
+  if (currentFrame < 0 || (streamsAcquired & stream))
+    return false;
+  streamsAcquired |= stream;
+  const SessionFrameHeader *header = reader.frameHeader(currentFrame);
+  return header != nullptr && header->streams[sessionStream].size == size && reader.streamData(currentFrame, sessionStream) != nullptr;
+}
+
+
+const DSP *ReplayFrameSourcePrivate::recordedMapping(int frame) const
+{
+  const SessionFrameHeader *header = reader.frameHeader(frame);
+  if (header == nullptr)
+    return nullptr;
+  const SessionStreamInfo &info = header->streams[SessionMappingStream];
+  if (info.format != SessionMappingDsp || info.size != ColorSize * sizeof(DSP))
+    return nullptr;
+  return reinterpret_cast<const DSP*>(reader.streamData(frame, SessionMappingStream));
+}
+
+
+ReplayFrameSource::ReplayFrameSource(const QString &fileName, bool fullSpeed)
+  : d_ptr(new ReplayFrameSourcePrivate(fileName, fullSpeed))
+{
+  // ...
+}
+
+
+ReplayFrameSource::~ReplayFrameSource()
+{
+  close();
+}
+
+
+bool ReplayFrameSource::open(void)
+{
+  Q_D(ReplayFrameSource);
+  qDebug() << "ReplayFrameSource::open()" << d->reader.fileName();
+  if (!d->reader.open())
+    return false;
+  // Sessions recorded with the sensor's calibration are mapped natively.
+  // Without one, the SDK's mapping recorded with --record-mapping is
+  // replayed, and if there's none, the nominal calibration has to do.
+  d->hasCalibration = d->reader.calibration(d->calibration);
+  if (!d->hasCalibration && d->recordedMapping(0) == nullptr) {
+    qDebug() << "No calibration recorded, mapping with nominal values.";
+    d->calibration = SensorCalibration::nominal();
+    d->hasCalibration = true;
+  }
+  d->currentFrame = -1;
+  d->mappingFrame.store(-1);
+  d->streamsAcquired = ReplayFrameSourcePrivate::AllStreams;
+  qDebug() << d->reader.frameCount() << "frames";
+  return true;
+}
+
+
+void ReplayFrameSource::close(void)
+{
+  Q_D(ReplayFrameSource);
+  d->reader.close();
+}
+
+
+bool ReplayFrameSource::isRealTime(void) const
+{
+  Q_D(const ReplayFrameSource);
+  return !d->fullSpeed;
+}
+
+
+int ReplayFrameSource::frameCount(void) const
+{
+  Q_D(const ReplayFrameSource);
+  return d->reader.frameCount();
+}
+
+
+void ReplayFrameSource::seek(int frame)
+{
+  Q_D(ReplayFrameSource);
+  d->currentFrame = qBound(0, frame, d->reader.frameCount()) - 1;
+  d->streamsAcquired = ReplayFrameSourcePrivate::AllStreams;
+}
+
+
+bool ReplayFrameSource::waitForFrames(int timeoutMs)
+{
+  Q_D(ReplayFrameSource);
+  if (!d->reader.isOpen())
+    return false;
+  if (d->streamsAcquired == ReplayFrameSourcePrivate::AllStreams) {
+    // at the end of the session start over
+    if (++d->currentFrame >= d->reader.frameCount())
+      d->currentFrame = 0;
+    d->streamsAcquired = ReplayFrameSourcePrivate::NoStream;
+    if (d->currentFrame == 0)
+      d->clock.invalidate();
+  }
+  const SessionFrameHeader *header = d->reader.frameHeader(d->currentFrame);
+  if (header == nullptr)
+    return false;
+  if (!d->clock.isValid()) {
+    d->firstTimestamp = header->streams[SessionDepthStream].timestamp;
+    d->clock.start();
+  }
+  if (d->fullSpeed)
+    return true;
+  // RelativeTime is measured in 100 ns ticks
+  const INT64 timestamp = header->streams[SessionDepthStream].timestamp;
+  const qint64 dueMs = (timestamp - d->firstTimestamp) / 10000 - d->clock.elapsed();
+  if (dueMs > timeoutMs) {
+    QThread::msleep(timeoutMs);
+    return false;
+  }
+  if (dueMs > 0)
+    QThread::msleep(dueMs);
+  return true;
+}
+
+
+bool ReplayFrameSource::acquireDepthFrame(DepthFrameData &frame)
+{
+  Q_D(ReplayFrameSource);
+  if (!d->streamAvailable(ReplayFrameSourcePrivate::DepthStream, SessionDepthStream, DepthSize * sizeof(UINT16)))
+    return false;
+  const SessionFrameHeader *header = d->reader.frameHeader(d->currentFrame);
+  if (header == nullptr)
+    return false;
+  memcpy(frame.buffer, d->reader.streamData(d->currentFrame, SessionDepthStream), DepthSize * sizeof(UINT16));
+  frame.timestamp = header->streams[SessionDepthStream].timestamp;
+  frame.width = DepthWidth;
+  frame.height = DepthHeight;
+  frame.minReliableDistance = header->minReliableDistance;
+  frame.maxReliableDistance = header->maxReliableDistance;
+  d->mappingFrame.storeRelease(d->currentFrame);
+  return true;
+}
+
+
+bool ReplayFrameSource::acquireColorFrame(ColorFrameData &frame)
+{
+  Q_D(ReplayFrameSource);
+  const SessionFrameHeader *header = d->reader.frameHeader(d->currentFrame);
+  if (header == nullptr)
+    return false;
+  frame.format = header->streams[SessionColorStream].format == SessionColorYuy2 ? ColorFormatYuy2 : ColorFormatBgra;
+  frame.width = ColorWidth;
+  frame.height = ColorHeight;
+  if (!d->streamAvailable(ReplayFrameSourcePrivate::ColorStream, SessionColorStream, quint64(frame.byteSize())))
+    return false;
+  memcpy(frame.buffer, d->reader.streamData(d->currentFrame, SessionColorStream), size_t(frame.byteSize()));
+  frame.timestamp = header->streams[SessionColorStream].timestamp;
+  return true;
+}
+
+
+bool ReplayFrameSource::acquireIRFrame(IRFrameData &frame)
+{
+  Q_D(ReplayFrameSource);
+  if (!d->streamAvailable(ReplayFrameSourcePrivate::IRStream, SessionIRStream, IRSize * sizeof(UINT16)))
+    return false;
+  const SessionFrameHeader *header = d->reader.frameHeader(d->currentFrame);
+  if (header == nullptr)
+    return false;
+  memcpy(frame.buffer, d->reader.streamData(d->currentFrame, SessionIRStream), IRSize * sizeof(UINT16));
+  frame.timestamp = header->streams[SessionIRStream].timestamp;
+  frame.width = IRWidth;
+  frame.height = IRHeight;
+  return true;
+}
+
+
+bool ReplayFrameSource::mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DepthSpacePoint *depthSpacePoints)
+{
+  Q_D(ReplayFrameSource);
+  Q_UNUSED(depthBuffer);
+  const DSP *mapping = d->recordedMapping(d->mappingFrame.loadAcquire());
+  if (mapping == nullptr)
+    return false;
+  // the recorded DSPs are the SDK's points rounded, -1 where it had none
+  for (int i = 0; i < ColorSize; ++i) {
+    if (mapping[i].x < 0 || mapping[i].y < 0) {
+      depthSpacePoints[i].X = -std::numeric_limits<float>::infinity();
+      depthSpacePoints[i].Y = -std::numeric_limits<float>::infinity();
+    }
+    else {
+      depthSpacePoints[i].X = float(mapping[i].x);
+      depthSpacePoints[i].Y = float(mapping[i].y);
+    }
+  }
+  return true;
+}
+
+
+bool ReplayFrameSource::mapColorFrameToDsp(const UINT16 *depthBuffer, DSP *dsp)
+{
+  Q_D(ReplayFrameSource);
+  Q_UNUSED(depthBuffer);
+  const DSP *mapping = d->recordedMapping(d->mappingFrame.loadAcquire());
+  if (mapping == nullptr)
+    return false;
+  // straight from the memory-mapped recording, no points in between
+  memcpy(dsp, mapping, ColorSize * sizeof(DSP));
+  return true;
+}
+
+
+bool ReplayFrameSource::calibration(SensorCalibration &calibration)
+{
+  Q_D(ReplayFrameSource);
+  if (!d->hasCalibration)
+    return false;
+  calibration = d->calibration;
+  return true;
+}
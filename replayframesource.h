@@ -0,0 +1,62 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __REPLAYFRAMESOURCE_H_
+#define __REPLAYFRAMESOURCE_H_
+
+#include <QScopedPointer>
+#include <QString>
+
+#include "framesource.h"
+
+class ReplayFrameSourcePrivate;
+
+// Plays back a recorded session (see sessionformat.h) in a loop, either
+// paced by the recorded timestamps or, if fullSpeed is set, as fast as
+// frames are requested. The next frame is due once all streams of the
+// current one were acquired.
+class ReplayFrameSource : public FrameSource
+{
+public:
+  explicit ReplayFrameSource(const QString &fileName, bool fullSpeed = false);
+  ~ReplayFrameSource();
+
+  virtual bool open(void);
+  virtual void close(void);
+  virtual bool isRealTime(void) const;
+  virtual bool waitForFrames(int timeoutMs);
+
+  int frameCount(void) const;
+  void seek(int frame);
+
+  virtual bool acquireDepthFrame(DepthFrameData&);
+  virtual bool acquireColorFrame(ColorFrameData&);
+  virtual bool acquireIRFrame(IRFrameData&);
+
+  virtual bool mapColorFrameToDepthSpace(const UINT16 *depthBuffer, DepthSpacePoint *depthSpacePoints);
+  virtual bool mapColorFrameToDsp(const UINT16 *depthBuffer, DSP *dsp);
+  virtual bool calibration(SensorCalibration&);
+
+private:
+  QScopedPointer<ReplayFrameSourcePrivate> d_ptr;
+  Q_DECLARE_PRIVATE(ReplayFrameSource)
+  Q_DISABLE_COPY(ReplayFrameSource)
+};
+
+#endif // __REPLAYFRAMESOURCE_H_
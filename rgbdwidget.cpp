@@ -19,23 +19,24 @@
 
 #include "globals.h"
 #include "util.h"
+#include "colorconversion.h"
 #include "rgbdwidget.h"
 
-#include <limits>
+#include <cstring>
 
 #include <QDebug>
 #include <QImage>
 #include <QPainter>
-#include <QMutexLocker>
 #include <QVector3D>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
 class RGBDWidgetPrivate
 {
 public:
   RGBDWidgetPrivate(void)
     : videoFrame(ColorWidth, ColorHeight, QImage::Format_ARGB32)
-    , depthSpaceData(new DepthSpacePoint[ColorSize])
-    , depthData(new UINT16[DepthSize])
+    , renderedFrame(ColorWidth, ColorHeight, QImage::Format_ARGB32)
     , tooNear(1100)
     , tooFar(2400)
     , minDepth(0)
@@ -43,23 +44,19 @@ public:
     , refPoints(NRefPoints)
     , ref3D(NRefPoints)
     , refPointIndex(0)
-    , kinectSensor(nullptr)
-    , coordinateMapper(nullptr)
     , windowAspectRatio(1.0)
     , imageAspectRatio(1.0)
   {
     // ...
   }
-  ~RGBDWidgetPrivate()
-  {
-    SafeRelease(coordinateMapper);
-    SafeDeleteArray(depthSpaceData);
-    SafeDeleteArray(depthData);
-  }
 
+  // a worker paints into renderedFrame, which is then swapped with videoFrame
   QImage videoFrame;
-  DepthSpacePoint *depthSpaceData;
-  UINT16 *depthData;
+  QImage renderedFrame;
+  ColorFrameRef pendingFrame;
+  QFutureWatcher<void> rendering;
+  MappingFrameRef mappingFrame;
+  DepthFrameRef depthFrame;
   RGBQUAD *colorData;
   int colorDataSize;
   int tooNear;
@@ -73,16 +70,43 @@ public:
   QVector<QVector3D> ref3D;
   QRect destRect;
 
-  IKinectSensor *kinectSensor;
-  ICoordinateMapper *coordinateMapper;
-
   qreal windowAspectRatio;
   qreal imageAspectRatio;
-
-  QMutex mtx;
 };
 
 
+static void paintDepthCoding(const ColorFrameRef &frame, const DepthFrameRef &depthFrame, const MappingFrameRef &mappingFrame, int tooNear, int tooFar, QRgb *dst)
+{
+  static const QRgb defaultColor = qRgb(88, 250, 44);
+  static const QRgb tooNearColor = qRgb(250, 44, 88);
+  static const QRgb tooFarColor = qRgb(88, 44, 250);
+
+  // convert in place and paint the depth coding over it
+  const QRgb *pBuffer = frame->buffer;
+  if (frame->format == ColorFormatYuy2) {
+    yuy2ToBgra(reinterpret_cast<const uchar*>(frame->buffer), dst, ColorSize);
+    pBuffer = dst;
+  }
+
+  const DSP *mapping = mappingFrame->buffer;
+  for (int colorIndex = 0; colorIndex < ColorSize; ++colorIndex) {
+    const int dx = mapping[colorIndex].x;
+    const int dy = mapping[colorIndex].y;
+    const QRgb *src = &defaultColor;
+    if (dx >= 0 && dx < DepthWidth && dy >= 0 && dy < DepthHeight) {
+      const int depth = depthFrame->buffer[dx + dy * DepthWidth];
+      if (depth < tooNear)
+        src = &tooNearColor;
+      else if (depth > tooFar)
+        src = &tooFarColor;
+      else
+        src = pBuffer + colorIndex;
+    }
+    dst[colorIndex] = *src;
+  }
+}
+
+
 RGBDWidget::RGBDWidget(QWidget *parent)
   : QWidget(parent)
   , d_ptr(new RGBDWidgetPrivate)
@@ -92,68 +116,76 @@ RGBDWidget::RGBDWidget(QWidget *parent)
   setMinimumSize(DepthWidth / 2, DepthHeight / 2);
   d->imageAspectRatio = qreal(d->videoFrame.width()) / qreal(d->videoFrame.height());
   setMaximumSize(d->videoFrame.size());
+  QObject::connect(&d->rendering, SIGNAL(finished()), SLOT(renderingFinished()));
+}
+
 
-  HRESULT hr = GetDefaultKinectSensor(&d->kinectSensor);
-  if (SUCCEEDED(hr) && d->kinectSensor != nullptr)
-    hr = d->kinectSensor->get_CoordinateMapper(&d->coordinateMapper);
+RGBDWidget::~RGBDWidget()
+{
+  Q_D(RGBDWidget);
+  d->rendering.waitForFinished();
 }
 
 
-void RGBDWidget::setColorData(INT64 nTime, const QRgb *pBuffer, int nWidth, int nHeight)
+void RGBDWidget::setMappingFrame(const MappingFrameRef &frame)
 {
   Q_D(RGBDWidget);
-  Q_UNUSED(nTime);
+  d->mappingFrame = frame;
+}
 
-  if (nWidth != ColorWidth || nHeight != ColorHeight || pBuffer == nullptr || d->videoFrame.isNull())
+
+void RGBDWidget::setColorFrame(const ColorFrameRef &frame)
+{
+  Q_D(RGBDWidget);
+
+  if (frame.isNull() || frame->width != ColorWidth || frame->height != ColorHeight || d->depthFrame.isNull() || d->mappingFrame.isNull())
     return;
 
-  d->mtx.lock();
-  QRgb *dst = reinterpret_cast<QRgb*>(d->videoFrame.bits());
-  static const QRgb defaultColor = qRgb(88, 250, 44);
-  static const QRgb tooNearColor = qRgb(250, 44, 88);
-  static const QRgb tooFarColor = qRgb(88, 44, 250);
+  d->pendingFrame = frame;
+  if (!d->rendering.isRunning())
+    startRendering();
+}
+
+
+void RGBDWidget::startRendering(void)
+{
+  Q_D(RGBDWidget);
+  // the worker gets its own references, so the widget can move on to the next frames meanwhile
+  const ColorFrameRef frame = d->pendingFrame;
+  const DepthFrameRef depthFrame = d->depthFrame;
+  const MappingFrameRef mappingFrame = d->mappingFrame;
+  const int tooNear = d->tooNear;
+  const int tooFar = d->tooFar;
+  d->pendingFrame.reset();
+  // nothing else refers to renderedFrame, so bits() doesn't detach
+  QRgb *dst = reinterpret_cast<QRgb*>(d->renderedFrame.bits());
+  d->rendering.setFuture(QtConcurrent::run([frame, depthFrame, mappingFrame, tooNear, tooFar, dst]() {
+    paintDepthCoding(frame, depthFrame, mappingFrame, tooNear, tooFar, dst);
+  }));
+}
 
-  for (int colorIndex = 0; colorIndex < ColorSize; ++colorIndex) {
-    const DepthSpacePoint &dsp = d->depthSpaceData[colorIndex];
-    const QRgb *src = &defaultColor;
-    if (dsp.X != -std::numeric_limits<float>::infinity() && dsp.Y != -std::numeric_limits<float>::infinity()) {
-      const int dx = qRound(dsp.X);
-      const int dy = qRound(dsp.Y);
-      if (dx >= 0 && dx < DepthWidth && dy >= 0 && dy < DepthHeight) {
-        const int depth = d->depthData[dx + dy * DepthWidth];
-        if (depth < d->tooNear)
-          src = &tooNearColor;
-        else if (depth > d->tooFar)
-          src = &tooFarColor;
-        else
-          src = pBuffer + colorIndex;
-      }
-    }
-    dst[colorIndex] = *src;
-  }
-  d->mtx.unlock();
 
+void RGBDWidget::renderingFinished(void)
+{
+  Q_D(RGBDWidget);
+  qSwap(d->videoFrame, d->renderedFrame);
   update();
+  if (!d->pendingFrame.isNull())
+    startRendering();
 }
 
 
-void RGBDWidget::setDepthData(INT64 nTime, const UINT16 *pBuffer, int nWidth, int nHeight, int nMinDepth, int nMaxDepth)
+void RGBDWidget::setDepthFrame(const DepthFrameRef &frame)
 {
   Q_D(RGBDWidget);
-  Q_UNUSED(nTime);
 
-  if (nWidth != DepthWidth || nHeight != DepthHeight || pBuffer == nullptr)
+  if (frame.isNull() || frame->width != DepthWidth || frame->height != DepthHeight)
     return;
 
-  QMutexLocker(&d->mtx);
-
-  d->minDepth = nMinDepth;
-  d->maxDepth = nMaxDepth;
+  d->minDepth = frame->minReliableDistance;
+  d->maxDepth = frame->maxReliableDistance;
 
-  memcpy_s(d->depthData, DepthSize * sizeof(UINT16), pBuffer, DepthSize * sizeof(UINT16));
-  HRESULT hr = d->coordinateMapper->MapColorFrameToDepthSpace(DepthSize, pBuffer, ColorSize, d->depthSpaceData);
-  if (FAILED(hr))
-    qWarning() << "MapColorFrameToDepthSpace() failed.";
+  d->depthFrame = frame;
 }
 
 
@@ -194,8 +226,6 @@ void RGBDWidget::paintEvent(QPaintEvent*)
   QPainter p(this);
   p.fillRect(rect(), Qt::gray);
 
-  QMutexLocker(&d->mtx);
-
   if (d->videoFrame.isNull() || qFuzzyIsNull(d->imageAspectRatio) || qFuzzyIsNull(d->windowAspectRatio))
     return;
 
@@ -216,10 +246,13 @@ void RGBDWidget::mousePressEvent(QMouseEvent *e)
     const QPoint &mPos = e->pos() - d->destRect.topLeft();
     const QPoint &p = QPoint(ColorWidth * mPos.x() / d->destRect.width(), ColorHeight *  mPos.y() / d->destRect.height());
     d->refPoints[d->refPointIndex] = p;
-    const DepthSpacePoint &dsp = d->depthSpaceData[p.x() + p.y() * ColorWidth];
-    const int dx = qRound(dsp.X);
-    const int dy = qRound(dsp.Y);
-    d->ref3D[d->refPointIndex] = QVector3D(float(p.x()), float(p.y()), float(d->depthData[dx + dy * DepthWidth]));
+    int depth = 0;
+    if (!d->mappingFrame.isNull() && !d->depthFrame.isNull()) {
+      const DSP &dsp = d->mappingFrame->buffer[p.x() + p.y() * ColorWidth];
+      if (dsp.x >= 0 && dsp.x < DepthWidth && dsp.y >= 0 && dsp.y < DepthHeight)
+        depth = d->depthFrame->buffer[dsp.x + dsp.y * DepthWidth];
+    }
+    d->ref3D[d->refPointIndex] = QVector3D(float(p.x()), float(p.y()), float(depth));
     if (++d->refPointIndex >= d->refPoints.count()) {
       emit refPointsSet(d->ref3D);
       d->refPointIndex = 0;
@@ -20,7 +20,8 @@
 #ifndef __RGBDWIDGET_H_
 #define __RGBDWIDGET_H_
 
-#include <Kinect.h>
+#include "kinectcompat.h"
+#include "frameset.h"
 
 #include <QWidget>
 #include <QPaintEvent>
@@ -37,8 +38,13 @@ class RGBDWidget : public QWidget
   Q_OBJECT
 public:
   explicit RGBDWidget(QWidget *parent = nullptr);
-  void setDepthData(INT64 nTime, const UINT16* pBuffer, int nWidth, int nHeight, int nMinDepth, int nMaxDepth);
-  void setColorData(INT64 nTime, const QRgb *pBuffer, int nWidth, int nHeight);
+  ~RGBDWidget();
+  void setMappingFrame(const MappingFrameRef&);
+  void setDepthFrame(const DepthFrameRef&);
+  // paints the depth coding over the frame on a worker thread, with the
+  // depth and mapping frames set before; while it's busy, only the
+  // latest of the frames set meanwhile is kept
+  void setColorFrame(const ColorFrameRef&);
   void setNearThreshold(int);
   void setFarThreshold(int);
 
@@ -47,12 +53,17 @@ public slots:
 signals:
   void refPointsSet(QVector<QVector3D>);
 
+private slots:
+  void renderingFinished(void);
+
 protected:
   void resizeEvent(QResizeEvent*);
   void paintEvent(QPaintEvent*);
   void mousePressEvent(QMouseEvent*);
 
 private:
+  void startRendering(void);
+
   QScopedPointer<RGBDWidgetPrivate> d_ptr;
   Q_DECLARE_PRIVATE(RGBDWidget)
   Q_DISABLE_COPY(RGBDWidget)
@@ -0,0 +1,246 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "globals.h"
+#include "sensorcalibration.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QVariantList>
+
+// the fit works in meters, the projection is applied to millimeters
+static const double MillimetersPerMeter = 1000.0;
+static const int UndistortIterations = 20;
+
+
+bool SensorCalibration::isValid(void) const
+{
+  return depthFx > 0.f && depthFy > 0.f && colorProjection[2][2] != 0.0;
+}
+
+
+void SensorCalibration::undistortDepthPixel(float u, float v, float &x, float &y) const
+{
+  const float xd = (u - depthCx) / depthFx;
+  const float yd = (v - depthCy) / depthFy;
+  x = xd;
+  y = yd;
+  for (int i = 0; i < UndistortIterations; ++i) {
+    const float r2 = x * x + y * y;
+    const float factor = 1.f + r2 * (depthK2 + r2 * (depthK4 + r2 * depthK6));
+    x = xd / factor;
+    y = yd / factor;
+  }
+}
+
+
+void SensorCalibration::colorProjectionTable(float *coeffU, float *coeffV, float *coeffW) const
+{
+  const double (*P)[4] = colorProjection;
+  for (int v = 0; v < DepthHeight; ++v) {
+    for (int u = 0; u < DepthWidth; ++u) {
+      float x, y;
+      undistortDepthPixel(float(u), float(v), x, y);
+      const int i = u + v * DepthWidth;
+      coeffU[i] = float(P[0][0] * x + P[0][1] * y + P[0][2]);
+      coeffV[i] = float(P[1][0] * x + P[1][1] * y + P[1][2]);
+      coeffW[i] = float(P[2][0] * x + P[2][1] * y + P[2][2]);
+    }
+  }
+}
+
+
+double SensorCalibration::fitColorProjection(const QVector<CalibrationSample> &samples)
+{
+  // With p22 fixed to 1, every sample yields two equations linear in
+  // the remaining eleven elements of the projection:
+  //   (p00 p01 p02 p03) . (X Y Z 1) - u * (p20 X + p21 Y + p23) = u * Z
+  //   (p10 p11 p12 p13) . (X Y Z 1) - v * (p20 X + p21 Y + p23) = v * Z
+  static const int N = 11;
+  double ata[N][N];
+  double atb[N];
+  memset(ata, 0, sizeof(ata));
+  memset(atb, 0, sizeof(atb));
+  int used = 0;
+  foreach (const CalibrationSample &sample, samples) {
+    if (sample.depth == 0 || !std::isfinite(sample.colorX) || !std::isfinite(sample.colorY))
+      continue;
+    float x, y;
+    undistortDepthPixel(sample.depthX, sample.depthY, x, y);
+    const double Z = sample.depth / MillimetersPerMeter;
+    const double X = x * Z;
+    const double Y = y * Z;
+    const double u = sample.colorX;
+    const double v = sample.colorY;
+    const double rows[2][N + 1] = {
+      { X, Y, Z, 1, 0, 0, 0, 0, -u * X, -u * Y, -u, u * Z },
+      { 0, 0, 0, 0, X, Y, Z, 1, -v * X, -v * Y, -v, v * Z }
+    };
+    for (int r = 0; r < 2; ++r) {
+      for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j)
+          ata[i][j] += rows[r][i] * rows[r][j];
+        atb[i] += rows[r][i] * rows[r][N];
+      }
+    }
+    ++used;
+  }
+  if (used < N)
+    return -1.0;
+
+  // Gaussian elimination with partial pivoting
+  for (int col = 0; col < N; ++col) {
+    int pivot = col;
+    for (int row = col + 1; row < N; ++row)
+      if (std::fabs(ata[row][col]) > std::fabs(ata[pivot][col]))
+        pivot = row;
+    if (std::fabs(ata[pivot][col]) < 1e-12)
+      return -1.0;
+    if (pivot != col) {
+      for (int j = 0; j < N; ++j)
+        qSwap(ata[col][j], ata[pivot][j]);
+      qSwap(atb[col], atb[pivot]);
+    }
+    for (int row = col + 1; row < N; ++row) {
+      const double f = ata[row][col] / ata[col][col];
+      for (int j = col; j < N; ++j)
+        ata[row][j] -= f * ata[col][j];
+      atb[row] -= f * atb[col];
+    }
+  }
+  double p[N];
+  for (int row = N - 1; row >= 0; --row) {
+    double sum = atb[row];
+    for (int j = row + 1; j < N; ++j)
+      sum -= ata[row][j] * p[j];
+    p[row] = sum / ata[row][row];
+  }
+
+  // scale the translational column from meters to millimeters
+  const double P[3][4] = {
+    { p[0], p[1], p[2], p[3] * MillimetersPerMeter },
+    { p[4], p[5], p[6], p[7] * MillimetersPerMeter },
+    { p[8], p[9], 1.0, p[10] * MillimetersPerMeter }
+  };
+  memcpy(colorProjection, P, sizeof(colorProjection));
+
+  double squaredError = 0.0;
+  foreach (const CalibrationSample &sample, samples) {
+    if (sample.depth == 0 || !std::isfinite(sample.colorX) || !std::isfinite(sample.colorY))
+      continue;
+    float x, y;
+    undistortDepthPixel(sample.depthX, sample.depthY, x, y);
+    const double Z = sample.depth;
+    const double w = P[2][0] * x * Z + P[2][1] * y * Z + P[2][2] * Z + P[2][3];
+    const double u = (P[0][0] * x * Z + P[0][1] * y * Z + P[0][2] * Z + P[0][3]) / w;
+    const double v = (P[1][0] * x * Z + P[1][1] * y * Z + P[1][2] * Z + P[1][3]) / w;
+    squaredError += (u - sample.colorX) * (u - sample.colorX) + (v - sample.colorY) * (v - sample.colorY);
+  }
+  return std::sqrt(squaredError / used);
+}
+
+
+bool SensorCalibration::load(const QString &fileName)
+{
+  if (!QFileInfo(fileName).isFile())
+    return false;
+  QSettings settings(fileName, QSettings::IniFormat);
+  SensorCalibration calibration;
+  calibration.depthFx = settings.value("depth/fx").toFloat();
+  calibration.depthFy = settings.value("depth/fy").toFloat();
+  calibration.depthCx = settings.value("depth/cx").toFloat();
+  calibration.depthCy = settings.value("depth/cy").toFloat();
+  calibration.depthK2 = settings.value("depth/k2").toFloat();
+  calibration.depthK4 = settings.value("depth/k4").toFloat();
+  calibration.depthK6 = settings.value("depth/k6").toFloat();
+  calibration.reserved = 0.f;
+  const QVariantList projection = settings.value("color/projection").toList();
+  if (projection.count() != 12)
+    return false;
+  for (int i = 0; i < 12; ++i)
+    calibration.colorProjection[i / 4][i % 4] = projection.at(i).toDouble();
+  if (!calibration.isValid())
+    return false;
+  *this = calibration;
+  return true;
+}
+
+
+bool SensorCalibration::save(const QString &fileName) const
+{
+  QDir().mkpath(QFileInfo(fileName).absolutePath());
+  QSettings settings(fileName, QSettings::IniFormat);
+  settings.setValue("depth/fx", depthFx);
+  settings.setValue("depth/fy", depthFy);
+  settings.setValue("depth/cx", depthCx);
+  settings.setValue("depth/cy", depthCy);
+  settings.setValue("depth/k2", depthK2);
+  settings.setValue("depth/k4", depthK4);
+  settings.setValue("depth/k6", depthK6);
+  QVariantList projection;
+  for (int i = 0; i < 12; ++i)
+    projection << colorProjection[i / 4][i % 4];
+  settings.setValue("color/projection", projection);
+  settings.sync();
+  if (settings.status() != QSettings::NoError) {
+    qWarning() << "Cannot write calibration to" << fileName;
+    return false;
+  }
+  return true;
+}
+
+
+SensorCalibration SensorCalibration::nominal(void)
+{
+  static const double ColorFx = 1081.37;
+  static const double ColorCx = 959.5;
+  static const double ColorCy = 539.5;
+  SensorCalibration calibration;
+  calibration.depthFx = 365.46f;
+  calibration.depthFy = 365.46f;
+  calibration.depthCx = 257.f;
+  calibration.depthCy = 205.f;
+  calibration.depthK2 = 0.f;
+  calibration.depthK4 = 0.f;
+  calibration.depthK6 = 0.f;
+  calibration.reserved = 0.f;
+  // both cameras looking the same way from the same spot
+  const double P[3][4] = {
+    { ColorFx, 0.0, ColorCx, 0.0 },
+    { 0.0, ColorFx, ColorCy, 0.0 },
+    { 0.0, 0.0, 1.0, 0.0 }
+  };
+  memcpy(calibration.colorProjection, P, sizeof(calibration.colorProjection));
+  return calibration;
+}
+
+
+QString SensorCalibration::cacheFileName(const QString &sensorId)
+{
+  QString id = sensorId;
+  id.replace(QRegExp("[^A-Za-z0-9_-]"), "_");
+  return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/calibration-" + id + ".ini";
+}
@@ -0,0 +1,85 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SENSORCALIBRATION_H_
+#define __SENSORCALIBRATION_H_
+
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+#include "kinectcompat.h"
+
+// A depth pixel probed through the SDK's coordinate mapper
+struct CalibrationSample {
+  float depthX;
+  float depthY;
+  UINT16 depth;
+  float colorX;
+  float colorY;
+};
+
+
+// The geometry the color frame is registered with the depth frame by.
+// The depth pixel (u, v) with the depth z (in millimeters) lies at
+// (x * z, y * z, z) in depth camera space, where (x, y) is (u, v)
+// normalized by the depth camera's focal lengths and principal point
+// and freed from its radial lens distortion. The color camera's
+// intrinsics and its pose relative to the depth camera are folded into
+// colorProjection, which maps depth camera space onto homogeneous color
+// pixel coordinates.
+//
+// Plain old data, because it's stored in session recordings as it is.
+struct SensorCalibration {
+  float depthFx;
+  float depthFy;
+  float depthCx;
+  float depthCy;
+  float depthK2;
+  float depthK4;
+  float depthK6;
+  float reserved;
+  double colorProjection[3][4];
+
+  bool isValid(void) const;
+
+  void undistortDepthPixel(float u, float v, float &x, float &y) const;
+  // the rows of colorProjection applied to (x, y, 1) of every depth
+  // pixel, so that the depth pixel i at depth z lands on
+  // (z * coeffU[i] + p03, z * coeffV[i] + p13) / (z * coeffW[i] + p23)
+  void colorProjectionTable(float *coeffU, float *coeffV, float *coeffW) const;
+
+  // fits colorProjection to the samples by linear least squares and
+  // returns the RMS reprojection error in color pixels, or a negative
+  // value if the samples don't determine the projection
+  double fitColorProjection(const QVector<CalibrationSample>&);
+
+  bool load(const QString &fileName);
+  bool save(const QString &fileName) const;
+
+  // nominal Kinect v2 values, good enough to roughly register a
+  // frame at whiteboard distance if the sensor's own aren't available
+  static SensorCalibration nominal(void);
+  // where the calibration of the sensor with the given id is cached
+  static QString cacheFileName(const QString &sensorId);
+};
+
+Q_DECLARE_METATYPE(SensorCalibration)
+
+#endif // __SENSORCALIBRATION_H_
@@ -0,0 +1,116 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SESSIONFORMAT_H_
+#define __SESSIONFORMAT_H_
+
+#include <QtGlobal>
+
+#include "kinectcompat.h"
+#include "sensorcalibration.h"
+
+// Layout of a recorded session (all values little endian):
+//
+//   SessionFileHeader, padded to SessionAlignment
+//   'FRAM' chunk: SessionChunkHeader, SessionFrameHeader, stream payloads
+//   'FRAM' chunk ...
+//   'INDX' chunk: SessionChunkHeader, SessionIndexEntry[frameCount]
+//
+// Every chunk and every stream payload starts on a SessionAlignment
+// boundary, so that a memory-mapped recording can be read in place.
+// If the recording wasn't closed properly, indexOffset is 0 and the
+// index has to be rebuilt by walking the chunks.
+//
+// Version 3 added the sensor calibration to the file header; version 2
+// recordings are read as if they had none.
+
+static const char SessionMagic[8] = { 'W', '1', 'S', 'E', 'S', 'S', 'N', '\0' };
+static const quint32 SessionVersion = 3;
+static const quint32 SessionMinVersion = 2;
+static const quint32 SessionAlignment = 4096;
+
+#define SESSION_FOURCC(a, b, c, d) (quint32(a) | (quint32(b) << 8) | (quint32(c) << 16) | (quint32(d) << 24))
+
+static const quint32 SessionFrameChunk = SESSION_FOURCC('F', 'R', 'A', 'M');
+static const quint32 SessionIndexChunk = SESSION_FOURCC('I', 'N', 'D', 'X');
+
+enum SessionStream {
+  SessionDepthStream = 0,
+  SessionIRStream,
+  SessionColorStream,
+  SessionMappingStream,
+  SessionStreamCount
+};
+
+enum SessionColorFormat {
+  SessionColorBgra = 0,
+  SessionColorYuy2
+};
+
+enum SessionMappingFormat {
+  // DSP per color pixel; 0 is what a stream that wasn't recorded reads as
+  SessionMappingDsp = 1
+};
+
+struct SessionFileHeader {
+  char magic[8];
+  quint32 version;
+  quint32 alignment;
+  quint64 indexOffset;
+  quint64 frameCount;
+  quint32 hasCalibration;
+  quint32 reserved;
+  SensorCalibration calibration;
+};
+
+struct SessionChunkHeader {
+  quint32 id;
+  quint32 reserved;
+  // size of the chunk including this header and trailing padding
+  quint64 size;
+};
+
+struct SessionStreamInfo {
+  quint32 format;
+  quint32 reserved;
+  INT64 timestamp;
+  // relative to the start of the chunk, size is 0 if the stream is absent
+  quint64 offset;
+  quint64 size;
+};
+
+struct SessionFrameHeader {
+  quint16 minReliableDistance;
+  quint16 maxReliableDistance;
+  quint32 reserved;
+  SessionStreamInfo streams[SessionStreamCount];
+};
+
+struct SessionIndexEntry {
+  quint64 offset;
+  INT64 timestamp;
+};
+
+
+inline quint64 sessionAligned(quint64 offset)
+{
+  return (offset + SessionAlignment - 1) & ~quint64(SessionAlignment - 1);
+}
+
+#endif // __SESSIONFORMAT_H_
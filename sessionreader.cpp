@@ -0,0 +1,207 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "sessionreader.h"
+
+#include <cstring>
+
+#include <QDebug>
+#include <QFile>
+#include <QVector>
+
+
+class SessionReaderPrivate {
+public:
+  SessionReaderPrivate(const QString &fileName)
+    : file(fileName)
+    , data(nullptr)
+    , size(0)
+  { /* ... */ }
+
+  bool loadIndex(void);
+  bool rebuildIndex(void);
+  bool isFrameChunk(quint64 offset) const;
+
+  QFile file;
+  const uchar *data;
+  quint64 size;
+  QVector<SessionIndexEntry> index;
+};
+
+
+// true if a complete frame chunk starts at offset
+bool SessionReaderPrivate::isFrameChunk(quint64 offset) const
+{
+  if (offset % SessionAlignment != 0 || offset > size || size - offset < sizeof(SessionChunkHeader) + sizeof(SessionFrameHeader))
+    return false;
+  const SessionChunkHeader *chunk = reinterpret_cast<const SessionChunkHeader*>(data + offset);
+  return chunk->id == SessionFrameChunk && chunk->size >= sizeof(SessionChunkHeader) + sizeof(SessionFrameHeader) && chunk->size <= size - offset;
+}
+
+
+bool SessionReaderPrivate::loadIndex(void)
+{
+  const SessionFileHeader *header = reinterpret_cast<const SessionFileHeader*>(data);
+  if (header->indexOffset == 0 || header->indexOffset % SessionAlignment != 0
+      || header->indexOffset > size || size - header->indexOffset < sizeof(SessionChunkHeader))
+    return false;
+  const SessionChunkHeader *chunk = reinterpret_cast<const SessionChunkHeader*>(data + header->indexOffset);
+  const quint64 entries = header->frameCount;
+  if (chunk->id != SessionIndexChunk || entries > (size - header->indexOffset - sizeof(SessionChunkHeader)) / sizeof(SessionIndexEntry))
+    return false;
+  index.resize(int(entries));
+  memcpy(index.data(), chunk + 1, entries * sizeof(SessionIndexEntry));
+  // an index pointing outside of the file is as good as none
+  foreach (const SessionIndexEntry &entry, index) {
+    if (!isFrameChunk(entry.offset)) {
+      index.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool SessionReaderPrivate::rebuildIndex(void)
+{
+  index.clear();
+  quint64 offset = sessionAligned(sizeof(SessionFileHeader));
+  while (isFrameChunk(offset)) {
+    const SessionChunkHeader *chunk = reinterpret_cast<const SessionChunkHeader*>(data + offset);
+    const SessionFrameHeader *frame = reinterpret_cast<const SessionFrameHeader*>(chunk + 1);
+    SessionIndexEntry entry;
+    entry.offset = offset;
+    entry.timestamp = frame->streams[SessionDepthStream].timestamp;
+    index.append(entry);
+    offset += chunk->size;
+  }
+  return !index.isEmpty();
+}
+
+
+SessionReader::SessionReader(const QString &fileName)
+  : d_ptr(new SessionReaderPrivate(fileName))
+{
+  // ...
+}
+
+
+SessionReader::~SessionReader()
+{
+  close();
+}
+
+
+bool SessionReader::open(void)
+{
+  Q_D(SessionReader);
+  if (!d->file.open(QIODevice::ReadOnly)) {
+    qWarning() << "Cannot open" << d->file.fileName() << ":" << d->file.errorString();
+    return false;
+  }
+  d->size = quint64(d->file.size());
+  d->data = d->size >= sizeof(SessionFileHeader) ? d->file.map(0, d->file.size()) : nullptr;
+  const SessionFileHeader *header = reinterpret_cast<const SessionFileHeader*>(d->data);
+  if (header == nullptr
+      || memcmp(header->magic, SessionMagic, sizeof(SessionMagic)) != 0
+      || header->version < SessionMinVersion
+      || header->version > SessionVersion
+      || header->alignment != SessionAlignment) {
+    qWarning() << d->file.fileName() << "is not a W-1 session recording.";
+    close();
+    return false;
+  }
+  if (!d->loadIndex()) {
+    qWarning() << d->file.fileName() << "wasn't closed properly or its index is damaged, rebuilding the index.";
+    if (!d->rebuildIndex()) {
+      qWarning() << d->file.fileName() << "doesn't contain any frames.";
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void SessionReader::close(void)
+{
+  Q_D(SessionReader);
+  if (d->data != nullptr)
+    d->file.unmap(const_cast<uchar*>(d->data));
+  d->data = nullptr;
+  d->size = 0;
+  d->index.clear();
+  d->file.close();
+}
+
+
+bool SessionReader::isOpen(void) const
+{
+  Q_D(const SessionReader);
+  return d->data != nullptr;
+}
+
+
+int SessionReader::frameCount(void) const
+{
+  Q_D(const SessionReader);
+  return d->index.count();
+}
+
+
+const SessionFrameHeader *SessionReader::frameHeader(int frame) const
+{
+  Q_D(const SessionReader);
+  if (frame < 0 || frame >= d->index.count())
+    return nullptr;
+  return reinterpret_cast<const SessionFrameHeader*>(d->data + d->index.at(frame).offset + sizeof(SessionChunkHeader));
+}
+
+
+const uchar *SessionReader::streamData(int frame, SessionStream stream) const
+{
+  Q_D(const SessionReader);
+  const SessionFrameHeader *header = frameHeader(frame);
+  if (header == nullptr)
+    return nullptr;
+  // open() made sure that the chunk lies within the file
+  const SessionChunkHeader *chunk = reinterpret_cast<const SessionChunkHeader*>(header) - 1;
+  const SessionStreamInfo &info = header->streams[stream];
+  if (info.size == 0 || info.offset > chunk->size || info.size > chunk->size - info.offset)
+    return nullptr;
+  return reinterpret_cast<const uchar*>(chunk) + info.offset;
+}
+
+
+bool SessionReader::calibration(SensorCalibration &calibration) const
+{
+  Q_D(const SessionReader);
+  const SessionFileHeader *header = reinterpret_cast<const SessionFileHeader*>(d->data);
+  if (header == nullptr || header->version < 3 || !header->hasCalibration || !header->calibration.isValid())
+    return false;
+  calibration = header->calibration;
+  return true;
+}
+
+
+QString SessionReader::fileName(void) const
+{
+  Q_D(const SessionReader);
+  return d->file.fileName();
+}
@@ -0,0 +1,57 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SESSIONREADER_H_
+#define __SESSIONREADER_H_
+
+#include <QScopedPointer>
+#include <QString>
+
+#include "sessionformat.h"
+
+class SessionReaderPrivate;
+
+// Memory-maps a session recording (see sessionformat.h) and gives
+// random access to each of its frames through the frame index.
+class SessionReader
+{
+public:
+  explicit SessionReader(const QString &fileName);
+  ~SessionReader();
+
+  bool open(void);
+  void close(void);
+  bool isOpen(void) const;
+
+  int frameCount(void) const;
+  const SessionFrameHeader *frameHeader(int frame) const;
+  // returns nullptr if the stream wasn't recorded for this frame
+  const uchar *streamData(int frame, SessionStream stream) const;
+  // false if the sensor's calibration wasn't recorded
+  bool calibration(SensorCalibration&) const;
+
+  QString fileName(void) const;
+
+private:
+  QScopedPointer<SessionReaderPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(SessionReader)
+  Q_DISABLE_COPY(SessionReader)
+};
+
+#endif // __SESSIONREADER_H_
@@ -0,0 +1,144 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "sessionwriter.h"
+#include "sessionrecorder.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QDebug>
+
+
+class SessionRecorderPrivate {
+public:
+  SessionRecorderPrivate(const QString &fileName)
+    : writer(fileName)
+    , hasCalibration(false)
+    , queued(0)
+    , head(0)
+    , droppedFrameSets(0)
+  { /* ... */ }
+
+  SessionWriter writer;
+  SensorCalibration calibration;
+  bool hasCalibration;
+  QMutex mutex;
+  QWaitCondition frameSetQueued;
+  FrameSet queue[RecorderQueueSize];
+  int queued;
+  int head;
+  QAtomicInt droppedFrameSets;
+};
+
+
+SessionRecorder::SessionRecorder(const QString &fileName, bool recordMapping, QObject *parent)
+  : QThread(parent)
+  , d_ptr(new SessionRecorderPrivate(fileName))
+{
+  d_ptr->writer.setRecordMapping(recordMapping);
+}
+
+
+SessionRecorder::~SessionRecorder()
+{
+  stop();
+}
+
+
+bool SessionRecorder::open(void)
+{
+  Q_D(SessionRecorder);
+  return d->writer.open();
+}
+
+
+void SessionRecorder::stop(void)
+{
+  Q_D(SessionRecorder);
+  if (isRunning()) {
+    requestInterruption();
+    {
+      QMutexLocker lock(&d->mutex);
+      d->frameSetQueued.wakeOne();
+    }
+    wait();
+  }
+  if (!d->writer.isOpen())
+    return;
+  {
+    QMutexLocker lock(&d->mutex);
+    if (d->hasCalibration)
+      d->writer.setCalibration(d->calibration);
+  }
+  d->writer.close();
+  qDebug() << "Recorded" << d->writer.frameCount() << "frames /" << d->writer.bytesWritten() << "bytes to" << d->writer.fileName()
+           << "; longest write took" << d->writer.maxWriteTime() << "ms;" << d->droppedFrameSets.load() << "frame sets dropped";
+}
+
+
+void SessionRecorder::enqueue(const FrameSet &frameSet)
+{
+  Q_D(SessionRecorder);
+  QMutexLocker lock(&d->mutex);
+  if (d->queued == RecorderQueueSize) {
+    d->droppedFrameSets.ref();
+    return;
+  }
+  d->queue[(d->head + d->queued) % RecorderQueueSize] = frameSet;
+  ++d->queued;
+  d->frameSetQueued.wakeOne();
+}
+
+
+void SessionRecorder::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(SessionRecorder);
+  QMutexLocker lock(&d->mutex);
+  d->calibration = calibration;
+  d->hasCalibration = true;
+}
+
+
+int SessionRecorder::droppedFrameSets(void) const
+{
+  Q_D(const SessionRecorder);
+  return d->droppedFrameSets.load();
+}
+
+
+void SessionRecorder::run(void)
+{
+  Q_D(SessionRecorder);
+  forever {
+    FrameSet frameSet;
+    {
+      QMutexLocker lock(&d->mutex);
+      while (d->queued == 0 && !isInterruptionRequested())
+        d->frameSetQueued.wait(&d->mutex);
+      if (d->queued == 0)
+        break;
+      frameSet = std::move(d->queue[d->head]);
+      d->head = (d->head + 1) % RecorderQueueSize;
+      --d->queued;
+    }
+    d->writer.write(frameSet);
+  }
+}
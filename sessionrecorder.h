@@ -0,0 +1,64 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SESSIONRECORDER_H_
+#define __SESSIONRECORDER_H_
+
+#include <QThread>
+#include <QScopedPointer>
+#include <QString>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+class SessionRecorderPrivate;
+
+// Writes frame sets to a session file on a thread of its own. The
+// queue holds references to the pooled frames, so enqueuing a set
+// copies nothing and a slow disk never stalls the capture thread.
+class SessionRecorder : public QThread
+{
+  Q_OBJECT
+
+public:
+  // recordMapping adds the color to depth mapping to every frame
+  explicit SessionRecorder(const QString &fileName, bool recordMapping = false, QObject *parent = nullptr);
+  ~SessionRecorder();
+
+  bool open(void);
+  // writes what's still queued and closes the file
+  void stop(void);
+
+  void enqueue(const FrameSet&);
+  // goes into the file header when the recording is closed
+  void setCalibration(const SensorCalibration&);
+
+  // sets that didn't fit into the queue
+  int droppedFrameSets(void) const;
+
+protected:
+  virtual void run(void);
+
+private:
+  QScopedPointer<SessionRecorderPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(SessionRecorder)
+  Q_DISABLE_COPY(SessionRecorder)
+};
+
+#endif // __SESSIONRECORDER_H_
@@ -0,0 +1,257 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "sessionformat.h"
+#include "sessionwriter.h"
+
+#include <cstring>
+
+#include <QDebug>
+#include <QFile>
+#include <QVector>
+#include <QElapsedTimer>
+
+static const char Padding[SessionAlignment] = { 0 };
+
+
+class SessionWriterPrivate {
+public:
+  SessionWriterPrivate(const QString &fileName)
+    : file(fileName)
+    , hasCalibration(false)
+    , recordMapping(false)
+    , bytesWritten(0)
+    , maxWriteTime(0)
+  { /* ... */ }
+
+  bool writePadded(const void *data, qint64 size);
+  bool writeFileHeader(quint64 indexOffset);
+
+  QFile file;
+  QVector<SessionIndexEntry> index;
+  SensorCalibration calibration;
+  bool hasCalibration;
+  bool recordMapping;
+  qint64 bytesWritten;
+  qint64 maxWriteTime;
+};
+
+
+bool SessionWriterPrivate::writePadded(const void *data, qint64 size)
+{
+  if (file.write(reinterpret_cast<const char*>(data), size) != size)
+    return false;
+  const qint64 padding = qint64(sessionAligned(quint64(size))) - size;
+  if (padding > 0 && file.write(Padding, padding) != padding)
+    return false;
+  bytesWritten += size + padding;
+  return true;
+}
+
+
+bool SessionWriterPrivate::writeFileHeader(quint64 indexOffset)
+{
+  SessionFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SessionMagic, sizeof(SessionMagic));
+  header.version = SessionVersion;
+  header.alignment = SessionAlignment;
+  header.indexOffset = indexOffset;
+  header.frameCount = quint64(index.count());
+  if (hasCalibration) {
+    header.hasCalibration = 1;
+    header.calibration = calibration;
+  }
+  return file.seek(0) && writePadded(&header, sizeof(header));
+}
+
+
+SessionWriter::SessionWriter(const QString &fileName)
+  : d_ptr(new SessionWriterPrivate(fileName))
+{
+  // ...
+}
+
+
+SessionWriter::~SessionWriter()
+{
+  close();
+}
+
+
+bool SessionWriter::open(void)
+{
+  Q_D(SessionWriter);
+  // unbuffered, so that QFile doesn't copy the frame data once more
+  if (!d->file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+    qWarning() << "Cannot open" << d->file.fileName() << "for writing:" << d->file.errorString();
+    return false;
+  }
+  d->index.clear();
+  d->index.reserve(30 * 60 * 10);
+  d->bytesWritten = 0;
+  d->maxWriteTime = 0;
+  return d->writeFileHeader(0);
+}
+
+
+void SessionWriter::close(void)
+{
+  Q_D(SessionWriter);
+  if (!d->file.isOpen())
+    return;
+  const quint64 indexOffset = quint64(d->file.pos());
+  const qint64 indexSize = d->index.count() * qint64(sizeof(SessionIndexEntry));
+  SessionChunkHeader chunk;
+  chunk.id = SessionIndexChunk;
+  chunk.reserved = 0;
+  chunk.size = sizeof(chunk) + indexSize;
+  bool ok = d->file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk)) == sizeof(chunk);
+  ok = ok && d->file.write(reinterpret_cast<const char*>(d->index.constData()), indexSize) == indexSize;
+  // cut off what a failed write() may have left behind
+  ok = ok && d->file.resize(d->file.pos());
+  ok = ok && d->writeFileHeader(indexOffset);
+  if (!ok)
+    qWarning() << "Writing the index of" << d->file.fileName() << "failed:" << d->file.errorString();
+  d->file.close();
+}
+
+
+bool SessionWriter::isOpen(void) const
+{
+  Q_D(const SessionWriter);
+  return d->file.isOpen();
+}
+
+
+void SessionWriter::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(SessionWriter);
+  d->calibration = calibration;
+  d->hasCalibration = true;
+}
+
+
+void SessionWriter::setRecordMapping(bool enabled)
+{
+  Q_D(SessionWriter);
+  d->recordMapping = enabled;
+}
+
+
+bool SessionWriter::write(const FrameSet &frameSet)
+{
+  Q_D(SessionWriter);
+  if (!d->file.isOpen())
+    return false;
+
+  QElapsedTimer t;
+  t.start();
+
+  const quint64 depthSize = DepthSize * sizeof(UINT16);
+  const quint64 irSize = IRSize * sizeof(UINT16);
+  const quint64 colorSize = quint64(frameSet.color->byteSize());
+  const bool withMapping = d->recordMapping && !frameSet.mapping.isNull();
+  const quint64 mappingSize = withMapping ? ColorSize * sizeof(DSP) : 0;
+
+  struct {
+    SessionChunkHeader chunk;
+    SessionFrameHeader frame;
+  } header;
+  memset(&header, 0, sizeof(header));
+  header.frame.minReliableDistance = quint16(frameSet.depth->minReliableDistance);
+  header.frame.maxReliableDistance = quint16(frameSet.depth->maxReliableDistance);
+
+  quint64 offset = sessionAligned(sizeof(header));
+  SessionStreamInfo &depth = header.frame.streams[SessionDepthStream];
+  depth.timestamp = frameSet.depth->timestamp;
+  depth.offset = offset;
+  depth.size = depthSize;
+  offset += sessionAligned(depthSize);
+  SessionStreamInfo &ir = header.frame.streams[SessionIRStream];
+  ir.timestamp = frameSet.ir->timestamp;
+  ir.offset = offset;
+  ir.size = irSize;
+  offset += sessionAligned(irSize);
+  SessionStreamInfo &color = header.frame.streams[SessionColorStream];
+  color.format = frameSet.color->format == ColorFormatYuy2 ? SessionColorYuy2 : SessionColorBgra;
+  color.timestamp = frameSet.color->timestamp;
+  color.offset = offset;
+  color.size = colorSize;
+  offset += sessionAligned(colorSize);
+  if (withMapping) {
+    SessionStreamInfo &mapping = header.frame.streams[SessionMappingStream];
+    mapping.format = SessionMappingDsp;
+    mapping.timestamp = frameSet.mapping->timestamp;
+    mapping.offset = offset;
+    mapping.size = mappingSize;
+    offset += sessionAligned(mappingSize);
+  }
+  header.chunk.id = SessionFrameChunk;
+  header.chunk.size = offset;
+
+  SessionIndexEntry entry;
+  entry.offset = quint64(d->file.pos());
+  entry.timestamp = frameSet.depth->timestamp;
+
+  bool ok = d->writePadded(&header, sizeof(header));
+  ok = ok && d->writePadded(frameSet.depth->buffer, depthSize);
+  ok = ok && d->writePadded(frameSet.ir->buffer, irSize);
+  ok = ok && d->writePadded(frameSet.color->buffer, colorSize);
+  if (withMapping)
+    ok = ok && d->writePadded(frameSet.mapping->buffer, mappingSize);
+  if (!ok) {
+    qWarning() << "Writing to" << d->file.fileName() << "failed:" << d->file.errorString();
+    // leave a consistent recording behind
+    d->file.seek(qint64(entry.offset));
+    return false;
+  }
+  d->index.append(entry);
+
+  d->maxWriteTime = qMax(d->maxWriteTime, t.elapsed());
+  return true;
+}
+
+
+QString SessionWriter::fileName(void) const
+{
+  Q_D(const SessionWriter);
+  return d->file.fileName();
+}
+
+
+qint64 SessionWriter::frameCount(void) const
+{
+  Q_D(const SessionWriter);
+  return d->index.count();
+}
+
+
+qint64 SessionWriter::bytesWritten(void) const
+{
+  Q_D(const SessionWriter);
+  return d->bytesWritten;
+}
+
+
+qint64 SessionWriter::maxWriteTime(void) const
+{
+  Q_D(const SessionWriter);
+  return d->maxWriteTime;
+}
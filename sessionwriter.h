@@ -0,0 +1,63 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SESSIONWRITER_H_
+#define __SESSIONWRITER_H_
+
+#include <QScopedPointer>
+#include <QString>
+
+#include "frameset.h"
+#include "sensorcalibration.h"
+
+class SessionWriterPrivate;
+
+// Appends frame sets to a session recording (see sessionformat.h).
+// The stream buffers are handed to the OS straight from the frame set
+// without being staged in an intermediate buffer.
+class SessionWriter
+{
+public:
+  explicit SessionWriter(const QString &fileName);
+  ~SessionWriter();
+
+  bool open(void);
+  void close(void);
+  bool isOpen(void) const;
+
+  // both may be set any time before close()
+  void setCalibration(const SensorCalibration&);
+  // whether to record the color to depth mapping (8 MB per frame)
+  void setRecordMapping(bool);
+
+  bool write(const FrameSet&);
+
+  QString fileName(void) const;
+  qint64 frameCount(void) const;
+  qint64 bytesWritten(void) const;
+  // the longest time write() took, in milliseconds
+  qint64 maxWriteTime(void) const;
+
+private:
+  QScopedPointer<SessionWriterPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(SessionWriter)
+  Q_DISABLE_COPY(SessionWriter)
+};
+
+#endif // __SESSIONWRITER_H_
@@ -0,0 +1,39 @@
+// Copyright (c) 2015 Oliver Lau <ola@ct.de>
+// All rights reserved.
+
+#version 330 core
+
+// FrameRenderer defines RADIUS, and HORIZONTAL for the first pass, so
+// that the loop has constant bounds and unrolls.
+
+uniform usampler2D uSource;
+
+layout(location = 0) out uvec4 fRange;
+
+#ifdef HORIZONTAL
+const ivec2 Direction = ivec2(1, 0);
+#else
+const ivec2 Direction = ivec2(0, 1);
+#endif
+
+
+// One pass of the separable minimum and maximum filter: the nearest
+// and farthest depth within RADIUS pixels along Direction. The first
+// pass reads the depth texture, the second one the ranges the first
+// one found.
+void main(void)
+{
+  ivec2 pos = ivec2(gl_FragCoord.xy);
+  ivec2 size = textureSize(uSource, 0);
+  uint nearest = 65535u;
+  uint farthest = 0u;
+  for (int i = -RADIUS; i <= RADIUS; ++i) {
+    uvec2 range = texelFetch(uSource, clamp(pos + i * Direction, ivec2(0), size - 1), 0).rg;
+#ifdef HORIZONTAL
+    range.g = range.r;
+#endif
+    nearest = min(nearest, range.r);
+    farthest = max(farthest, range.g);
+  }
+  fRange = uvec4(nearest, farthest, 0u, 0u);
+}
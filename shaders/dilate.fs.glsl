@@ -0,0 +1,25 @@
+// Copyright (c) 2015 Oliver Lau <ola@ct.de>
+// All rights reserved.
+
+#version 330 core
+
+uniform sampler2D uSplatTexture;
+
+layout(location = 0) out ivec4 fDsp;
+
+const ivec2 iColorSize = ivec2(1920, 1080);
+const ivec2 Neighbors[8] = ivec2[8](
+  ivec2(-1,  0), ivec2(+1,  0), ivec2( 0, -1), ivec2( 0, +1),
+  ivec2(-1, -1), ivec2(+1, -1), ivec2(-1, +1), ivec2(+1, +1));
+
+
+// Fills the cracks the splatted depth pixels left with a neighbor's
+// mapping and converts the result to DSPs for uMapTexture.
+void main(void)
+{
+  ivec2 pos = ivec2(gl_FragCoord.xy);
+  vec2 dsp = texelFetch(uSplatTexture, pos, 0).xy;
+  for (int i = 0; i < 8 && dsp.x < 0.0; ++i)
+    dsp = texelFetch(uSplatTexture, clamp(pos + Neighbors[i], ivec2(0), iColorSize - 1), 0).xy;
+  fDsp = ivec4(ivec2(dsp), 0, 0);
+}
@@ -1,58 +1,119 @@
 // Copyright (c) 2015 Oliver Lau <ola@ct.de>
 // All rights reserved.
 
-#version 130
-#extension GL_EXT_gpu_shader4 : enable
+#version 330 core
+
+// FrameRenderer compiles a variant of this shader for every
+// combination of these macros it needs:
+//   IGNORE_DEPTH   shows the whole video frame (there's no previous one)
+//   VIDEO_IS_YUY2  uVideoTexture holds YUY2 macropixels
+//   GAMMA, SATURATION, CONTRAST  apply the stage, left out at 1.0
+//   MASK_PASS      only decides which pixels to keep, into a mask at a
+//                  fraction of the color resolution
+//   UPSAMPLED_MASK takes that decision from the bilinearly upsampled
+//                  mask in uMaskTexture and blends along its edges
 
 smooth in vec2 vTexCoord;
-uniform usampler2D uDepthTexture;
+uniform usampler2D uDepthRangeTexture;
 uniform sampler2D uVideoTexture;
 uniform isampler2D uMapTexture;
 uniform sampler2D uImageTexture;
-uniform float uGamma;
-uniform float uContrast;
-uniform float uSaturation;
+uniform sampler2D uMaskTexture;
 uniform float uSharpen[9];
 uniform vec2 uOffset[9];
-uniform vec2 uHalo[1024];
-uniform int uHaloSize;
-uniform float uFarThreshold;
-uniform float uNearThreshold;
-uniform bool uIgnoreDepth;
+
+// shared by all variants and updated in one go, see MixParameters
+layout(std140) uniform Parameters {
+  float uGamma;
+  float uContrast;
+  float uSaturation;
+  float uNearThreshold;
+  float uFarThreshold;
+};
+
+layout(location = 0) out vec4 fColor;
 
 
 const ivec2 iDepthSize = ivec2(512, 424);
-const vec2 fDepthSize = vec2(iDepthSize);
+const ivec2 iColorSize = ivec2(1920, 1080);
 
+// BT.601 studio swing, same coefficients as the Kinect SDK
+const mat3 YuvToRgb = mat3(
+  298.0,  298.0, 298.0,
+    0.0, -100.0, 516.0,
+  409.0, -208.0,   0.0) / 256.0;
 
-bool allDepthsValidWithinHalo(vec2 coord) {
-  for (int i = 0; i < uHaloSize; ++i) {
-    float depth = float(texture2D(uDepthTexture, coord + uHalo[i]).r);
-    if (depth < uNearThreshold || depth > uFarThreshold)
-      return false;
-  }
-  return true;
+
+// uVideoTexture holds a Y0 U Y1 V macropixel in each texel
+vec3 yuy2ToRgb(vec2 coord) {
+  ivec2 pos = min(ivec2(coord * vec2(iColorSize)), iColorSize - 1);
+  vec4 macropixel = texelFetch(uVideoTexture, ivec2(pos.x / 2, pos.y), 0);
+  float y = ((pos.x & 1) == 0) ? macropixel.r : macropixel.b;
+  vec3 yuv = vec3(y, macropixel.g, macropixel.a) * 255.0 - vec3(16.0, 128.0, 128.0);
+  return clamp(YuvToRgb * yuv / 255.0, 0.0, 1.0);
+}
+
+
+// uDepthRangeTexture holds the nearest and farthest depth within the halo
+bool allDepthsValidWithinHalo(ivec2 dsp) {
+  uvec2 range = texelFetch(uDepthRangeTexture, dsp, 0).rg;
+  return float(range.r) >= uNearThreshold && float(range.g) <= uFarThreshold;
+}
+
+
+// 1.0 if the color pixel is to be kept, 0.0 if the previous image
+// shows through
+float keep(void) {
+  ivec2 dsp = texture(uMapTexture, vTexCoord).xy;
+  if (dsp.x < 0 || dsp.y < 0 || dsp.x >= iDepthSize.x || dsp.y >= iDepthSize.y || !allDepthsValidWithinHalo(dsp))
+    return 0.0;
+  return 1.0;
+}
+
+
+vec3 videoColor(void) {
+#ifdef VIDEO_IS_YUY2
+  return yuy2ToRgb(vTexCoord);
+#else
+  return texture(uVideoTexture, vTexCoord).rgb;
+#endif
 }
 
 
 void main(void)
 {
-  vec3 color = vec3(0.0);
-  ivec2 dsp = texture2D(uMapTexture, vTexCoord).xy;
-  vec2 coord = vec2(dsp) / fDepthSize;
-  if (uIgnoreDepth || (dsp.x >= 0 && dsp.y >= 0 && dsp.x < iDepthSize.x && dsp.y < iDepthSize.y && allDepthsValidWithinHalo(coord))) {
-    color = texture2D(uVideoTexture, vTexCoord).rgb;
-    // gamma correction
-    color = pow(color, vec3(1.0 / uGamma));
-    // saturation
-    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
-    vec3 gray = vec3(luminance);
-    color = mix(gray, color, uSaturation);
-    // contrast
-    color = (color - 0.5) * uContrast + 0.5;
-  }
-  else {
-    color = texture2D(uImageTexture, vTexCoord).rgb;
+#ifdef MASK_PASS
+  fColor = vec4(keep());
+#else
+#if defined(UPSAMPLED_MASK)
+  float kept = texture(uMaskTexture, vTexCoord).r;
+#elif !defined(IGNORE_DEPTH)
+  float kept = keep();
+#else
+  float kept = 1.0;
+#endif
+  if (kept == 0.0) {
+    fColor = vec4(texture(uImageTexture, vTexCoord).rgb, 1.0);
+    return;
   }
-  gl_FragColor = vec4(color, 1.0);
+  vec3 color = videoColor();
+#ifdef GAMMA
+  // gamma correction
+  color = pow(color, vec3(1.0 / uGamma));
+#endif
+#ifdef SATURATION
+  // saturation
+  float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  vec3 gray = vec3(luminance);
+  color = mix(gray, color, uSaturation);
+#endif
+#ifdef CONTRAST
+  // contrast
+  color = (color - 0.5) * uContrast + 0.5;
+#endif
+#ifdef UPSAMPLED_MASK
+  color = mix(texture(uImageTexture, vTexCoord).rgb, color, kept);
+#endif
+  fColor = vec4(color, 1.0);
+#endif
 }
@@ -1,8 +1,7 @@
 // Copyright (c) 2015 Oliver Lau <ola@ct.de>
 // All rights reserved.
 
-#version 150 core
-#extension GL_EXT_gpu_shader4 : enable
+#version 330 core
 
 in vec4 aVertex;
 in vec4 aTexCoord;
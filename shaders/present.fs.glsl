@@ -0,0 +1,15 @@
+// Copyright (c) 2015 Oliver Lau <ola@ct.de>
+// All rights reserved.
+
+#version 330 core
+
+smooth in vec2 vTexCoord;
+uniform sampler2D uImageTexture;
+
+layout(location = 0) out vec4 fColor;
+
+
+void main(void)
+{
+  fColor = vec4(texture(uImageTexture, vTexCoord).rgb, 1.0);
+}
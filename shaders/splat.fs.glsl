@@ -0,0 +1,17 @@
+// Copyright (c) 2015 Oliver Lau <ola@ct.de>
+// All rights reserved.
+
+#version 330 core
+
+flat in vec2 vDepthPixel;
+
+layout(location = 0) out vec4 fDsp;
+
+
+void main(void)
+{
+  // the depth test lets the nearest depth pixel win; of equally
+  // near ones the one whose center is the closest
+  gl_FragDepth = gl_FragCoord.z + 1e-4 * length(gl_PointCoord - 0.5);
+  fDsp = vec4(vDepthPixel, 0.0, 1.0);
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2015 Oliver Lau <ola@ct.de>
+// All rights reserved.
+
+#version 330 core
+
+in vec2 aDepthPixel;
+
+uniform usampler2D uDepthTexture;
+uniform sampler2D uProjectionTexture;
+uniform vec3 uProjectionOffset;
+
+flat out vec2 vDepthPixel;
+
+const vec2 fColorSize = vec2(1920.0, 1080.0);
+const float MaxDepth = 8000.0;
+
+
+// Projects the depth pixel into the color frame (see SensorCalibration).
+// Pixels without a depth are moved out of the clip volume.
+void main(void)
+{
+  ivec2 pos = ivec2(aDepthPixel);
+  float z = float(texelFetch(uDepthTexture, pos, 0).r);
+  vec3 projected = texelFetch(uProjectionTexture, pos, 0).xyz * z + uProjectionOffset;
+  vec2 colorPos = projected.xy / projected.z;
+  vDepthPixel = aDepthPixel;
+  if (z > 0.0 && projected.z > 0.0)
+    gl_Position = vec4((colorPos + 0.5) / fColorSize * 2.0 - 1.0, z / MaxDepth * 2.0 - 1.0, 1.0);
+  else
+    gl_Position = vec4(-2.0, -2.0, -2.0, 1.0);
+}
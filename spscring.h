@@ -0,0 +1,91 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SPSCRING_H_
+#define __SPSCRING_H_
+
+#include <QAtomicInteger>
+#include <QtGlobal>
+
+#include "util.h"
+
+// Bounded lock-free ring for exactly one producer and one consumer
+// thread. The slots are preallocated and reused in place: the producer
+// fills the slot returned by beginWrite() and publishes it with
+// endWrite(), the consumer reads front() and hands it back with pop().
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(quint32 capacity)
+    : mCapacity(capacity)
+    , mMask(capacity - 1)
+    , mSlots(new T[capacity])
+    , mHead(0)
+    , mTail(0)
+  {
+    Q_ASSERT_X(capacity > 0 && (capacity & (capacity - 1)) == 0, "SpscRing::SpscRing()", "capacity must be a power of two");
+  }
+  ~SpscRing()
+  {
+    SafeDeleteArray(mSlots);
+  }
+
+  quint32 capacity(void) const { return mCapacity; }
+  quint32 count(void) const { return mHead.loadAcquire() - mTail.loadAcquire(); }
+  bool isEmpty(void) const { return count() == 0; }
+
+  // producer side
+  T *beginWrite(void)
+  {
+    const quint32 head = mHead.load();
+    if (head - mTail.loadAcquire() == mCapacity)
+      return nullptr;
+    return &mSlots[head & mMask];
+  }
+  void endWrite(void)
+  {
+    mHead.storeRelease(mHead.load() + 1);
+  }
+
+  // consumer side
+  T *front(void)
+  {
+    const quint32 tail = mTail.load();
+    if (mHead.loadAcquire() == tail)
+      return nullptr;
+    return &mSlots[tail & mMask];
+  }
+  void pop(void)
+  {
+    mTail.storeRelease(mTail.load() + 1);
+  }
+
+private:
+  const quint32 mCapacity;
+  const quint32 mMask;
+  T *mSlots;
+  // keep producer and consumer indexes on separate cache lines
+  alignas(64) QAtomicInteger<quint32> mHead;
+  alignas(64) QAtomicInteger<quint32> mTail;
+
+  Q_DISABLE_COPY(SpscRing)
+};
+
+#endif // __SPSCRING_H_
@@ -19,44 +19,24 @@
 
 #include "util.h"
 #include "threedwidget.h"
-
-#include <limits>
+#include "renderthread.h"
+#include "imagepresenter.h"
 
 #include <QtMath>
 #include <QDebug>
 #include <QString>
-#include <QGLFramebufferObject>
-#include <QGLShaderProgram>
+#include <QStringList>
+#include <QOpenGLFramebufferObject>
 #include <QMatrix4x4>
-#include <QVector2D>
-#include <QVector3D>
-#include <QFile>
 #include <QRect>
 #include <QSizeF>
 #include <QPoint>
+#include <QPainter>
+#include <QFont>
+#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
 
-#include <Kinect.h>
-
-static const int PROGRAM_VERTEX_ATTRIBUTE = 0;
-static const int PROGRAM_TEXCOORD_ATTRIBUTE = 1;
-static const QVector2D Vertices[4] = {
-  QVector2D(+1.920f, +1.080f),
-  QVector2D(+1.920f, -1.080f),
-  QVector2D(-1.920f, +1.080f),
-  QVector2D(-1.920f, -1.080f)
-};
-static const QVector2D Vertices4FBO[4] = {
-  QVector2D(-1.f, -1.f),
-  QVector2D(-1.f, +1.f),
-  QVector2D(+1.f, -1.f),
-  QVector2D(+1.f, +1.f)
-};
-static const QVector2D TexCoords[4] = {
-  QVector2D(0, 0),
-  QVector2D(0, 1),
-  QVector2D(1, 0),
-  QVector2D(1, 1)
-};
 
 static const QVector3D XAxis(1.f, 0.f, 0.f);
 static const QVector3D YAxis(0.f, 1.f, 0.f);
@@ -66,20 +46,6 @@ static const float HFOV = 70.f;
 static const float VFOV = 60.f;
 
 
-struct DSP {
-  DSP(void)
-    : x(0)
-    , y(0)
-  { /* ... */ }
-  DSP(const DepthSpacePoint *dsp)
-    : x((dsp->X == -std::numeric_limits<float>::infinity()) ? -1 : INT16(dsp->X))
-    , y((dsp->Y == -std::numeric_limits<float>::infinity()) ? -1 : INT16(dsp->Y))
-  { /* ... */ }
-  INT16 x;
-  INT16 y;
-};
-
-
 class ThreeDWidgetPrivate {
 public:
   ThreeDWidgetPrivate(void)
@@ -89,29 +55,16 @@ public:
     , xTrans(0.f)
     , yTrans(0.f)
     , zTrans(-1.35f)
+    , renderThread(nullptr)
+    , forwardMapping(false)
+    , hasCalibration(false)
     , scale(1.0)
-    , lastFrameFBO(nullptr)
-    , imageFBO(nullptr)
-    , shaderProgram(nullptr)
-    , mapping(new DepthSpacePoint[ColorSize])
-    , intMapping(new DSP[ColorSize])
-    , timestamp(0)
     , firstPaintEventPending(true)
-    , frameCount(0)
-    , haloSize(0)
-  {
-  }
+    , timingOverlayVisible(false)
+  { /* ... */ }
   ~ThreeDWidgetPrivate()
   {
-    SafeRelease(coordinateMapper);
-    SafeDelete(shaderProgram);
-    SafeDelete(lastFrameFBO);
-    SafeDelete(imageFBO);
-    SafeDeleteArray(mapping);
-  }
-
-  bool mixShaderProgramIsValid(void) const {
-    return shaderProgram != nullptr && shaderProgram->isLinked();
+    SafeDelete(renderThread);
   }
 
   GLfloat xRot;
@@ -122,52 +75,28 @@ public:
   GLfloat zTrans;
   QMatrix4x4 mvMatrix;
 
-  QGLFramebufferObject *lastFrameFBO;
-  QGLFramebufferObject *imageFBO;
-  QGLShaderProgram *shaderProgram;
-
-  static const int MaxHaloSize = 2 * 16 * 2 * 16;
-  int haloSize;
-  QVector2D halo[MaxHaloSize];
-
-  IKinectSensor *kinectSensor;
-  ICoordinateMapper *coordinateMapper;
-  DepthSpacePoint *mapping;
-  DSP *intMapping;
-
-  GLuint videoTextureHandle;
-  GLuint depthTextureHandle;
-  GLuint mapTextureHandle;
-
-  GLint imageTextureLocation;
-  GLint videoTextureLocation;
-  GLint depthTextureLocation;
-  GLint mapTextureLocation;
-  GLint nearThresholdLocation;
-  GLint farThresholdLocation;
-  GLint gammaLocation;
-  GLint contrastLocation;
-  GLint saturationLocation;
-  GLint mvMatrixLocation;
-  GLint haloLocation;
-  GLint haloSizeLocation;
-  GLint ignoreDepthLocation;
+  RenderThread *renderThread;
+  ImagePresenter presenter;
+  // what the render thread gets once it's started
+  RenderParameters parameters;
+  bool forwardMapping;
+  SensorCalibration calibration;
+  bool hasCalibration;
+  // collects the changes of one display refresh
+  QTimer parameterTimer;
 
   qreal scale;
   QRect viewport;
   QSize resolution;
   QPoint offset;
   QPoint lastMousePos;
-  INT64 timestamp;
   bool firstPaintEventPending;
-  int frameCount;
+  bool timingOverlayVisible;
 };
 
 
-static const QGLFormat DefaultGLFormat = QGLFormat(QGL::DoubleBuffer | QGL::NoDepthBuffer | QGL::AlphaChannel | QGL::NoAccumBuffer | QGL::NoStencilBuffer | QGL::NoStereoBuffers | QGL::HasOverlay | QGL::NoSampleBuffers);
-
 ThreeDWidget::ThreeDWidget(QWidget *parent)
-  : QGLWidget(DefaultGLFormat, parent)
+  : QOpenGLWidget(parent)
   , d_ptr(new ThreeDWidgetPrivate)
 {
   Q_D(ThreeDWidget);
@@ -178,118 +107,86 @@ ThreeDWidget::ThreeDWidget(QWidget *parent)
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
   setMaximumSize(ColorWidth, ColorHeight);
   setMinimumSize(ColorWidth / 8, ColorHeight / 8);
-  HRESULT hr = GetDefaultKinectSensor(&d->kinectSensor);
-  if (SUCCEEDED(hr) && d->kinectSensor != nullptr)
-    hr = d->kinectSensor->get_CoordinateMapper(&d->coordinateMapper);
+
+  const QScreen *screen = QGuiApplication::primaryScreen();
+  const qreal refreshRate = screen != nullptr && screen->refreshRate() > 0 ? screen->refreshRate() : 60;
+  d->parameterTimer.setSingleShot(true);
+  d->parameterTimer.setInterval(qCeil(1000 / refreshRate));
+  QObject::connect(&d->parameterTimer, SIGNAL(timeout()), SLOT(publishParameters()));
 }
 
 
 ThreeDWidget::~ThreeDWidget()
 {
-  // ...
+  // the render thread's context shares the image textures with this one
+  stop();
+  // the presenter releases its GL resources
+  makeCurrent();
 }
 
 
-void ThreeDWidget::makeShader(void)
+void ThreeDWidget::initializeGL(void)
 {
   Q_D(ThreeDWidget);
-  SafeRenew(d->shaderProgram, new QGLShaderProgram);
-  d->shaderProgram->addShaderFromSourceFile(QGLShader::Fragment, ":/shaders/mix.fs.glsl");
-  d->shaderProgram->addShaderFromSourceFile(QGLShader::Vertex, ":/shaders/mix.vs.glsl");
-  d->shaderProgram->bindAttributeLocation("aVertex", PROGRAM_VERTEX_ATTRIBUTE);
-  d->shaderProgram->bindAttributeLocation("aTexCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
-  d->shaderProgram->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
-  d->shaderProgram->enableAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE);
-  d->shaderProgram->setAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE, TexCoords);
-  d->shaderProgram->link();
-  qDebug() << "Shader linker says:" << d->shaderProgram->log();
-  Q_ASSERT_X(d->mixShaderProgramIsValid(), "ThreeDWidget::makeShader()", "error in shader program");
-  d->shaderProgram->bind();
+  initializeOpenGLFunctions();
+  d->presenter.initialize();
+  makeWorldMatrix();
+}
 
-  d->videoTextureLocation = d->shaderProgram->uniformLocation("uVideoTexture");
-  d->shaderProgram->setUniformValue(d->videoTextureLocation, 0);
 
-  d->depthTextureLocation = d->shaderProgram->uniformLocation("uDepthTexture");
-  d->shaderProgram->setUniformValue(d->depthTextureLocation, 1);
+void ThreeDWidget::start(CaptureThread *captureThread)
+{
+  Q_D(ThreeDWidget);
+  Q_ASSERT_X(d->renderThread == nullptr, "ThreeDWidget::start()", "render thread already started");
+  d->renderThread = new RenderThread(captureThread, context());
+  d->renderThread->setForwardMapping(d->forwardMapping);
+  d->renderThread->setParameters(d->parameters);
+  if (d->hasCalibration)
+    d->renderThread->setCalibration(d->calibration);
+  QObject::connect(d->renderThread, SIGNAL(imageAvailable()), SLOT(takeImage()), Qt::QueuedConnection);
+  d->renderThread->start(QThread::HighPriority);
+}
 
-  d->mapTextureLocation = d->shaderProgram->uniformLocation("uMapTexture");
-  d->shaderProgram->setUniformValue(d->mapTextureLocation, 2);
 
-  d->imageTextureLocation = d->shaderProgram->uniformLocation("uImageTexture");
-  d->shaderProgram->setUniformValue(d->imageTextureLocation, 3);
+void ThreeDWidget::stop(void)
+{
+  Q_D(ThreeDWidget);
+  if (d->renderThread != nullptr)
+    d->renderThread->stop();
+}
 
-  d->gammaLocation = d->shaderProgram->uniformLocation("uGamma");
-  d->contrastLocation = d->shaderProgram->uniformLocation("uContrast");
-  d->saturationLocation = d->shaderProgram->uniformLocation("uSaturation");
-  d->nearThresholdLocation = d->shaderProgram->uniformLocation("uNearThreshold");
-  d->farThresholdLocation = d->shaderProgram->uniformLocation("uFarThreshold");
-  d->mvMatrixLocation = d->shaderProgram->uniformLocation("uMatrix");
-  d->haloLocation = d->shaderProgram->uniformLocation("uHalo");
-  d->haloSizeLocation = d->shaderProgram->uniformLocation("uHaloSize");
-  d->ignoreDepthLocation = d->shaderProgram->uniformLocation("uIgnoreDepth");
 
-  d->shaderProgram->setUniformValue(d->ignoreDepthLocation, true);
+// Images are only taken while they can be seen. Until then the render
+// thread goes on removing and replaces the image that's waiting, and
+// the previews fed from here stay idle, too.
+void ThreeDWidget::takeImage(void)
+{
+  if (!isVisible() || window()->isMinimized())
+    return;
+  exchangeImage();
 }
 
 
-void ThreeDWidget::initializeGL(void)
+// The image drawn so far is given back first, so that the render
+// thread can use it again once the GPU has drawn it for the last time.
+void ThreeDWidget::exchangeImage(void)
 {
   Q_D(ThreeDWidget);
-
-  initializeOpenGLFunctions();
-
-  glDisable(GL_ALPHA_TEST);
-  glDisable(GL_TEXTURE_2D);
-  glDisable(GL_DEPTH_TEST);
-  glDisable(GL_CULL_FACE);
-  glDepthMask(GL_FALSE);
-  glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-  glGenTextures(1, &d->videoTextureHandle);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, d->videoTextureHandle);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-  glGenTextures(1, &d->depthTextureHandle);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, d->depthTextureHandle);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-  glGenTextures(1, &d->mapTextureHandle);
-  glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_2D, d->mapTextureHandle);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-  d->imageFBO = new QGLFramebufferObject(ColorWidth, ColorHeight);
-  d->lastFrameFBO = new QGLFramebufferObject(ColorWidth, ColorHeight);
-
-  glActiveTexture(GL_TEXTURE3);
-  glBindTexture(GL_TEXTURE_2D, d->lastFrameFBO->texture());
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-  glActiveTexture(GL_TEXTURE4);
-  glBindTexture(GL_TEXTURE_2D, d->imageFBO->texture());
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-  makeWorldMatrix();
-  makeShader();
-  setHaloSize(3);
+  if (d->renderThread == nullptr || !d->presenter.isInitialized() || !d->renderThread->hasImage())
+    return;
+  makeCurrent();
+  GLsync fence = nullptr;
+  const GLuint releasedTexture = d->presenter.releaseImage(&fence);
+  if (releasedTexture != 0)
+    d->renderThread->releaseImage(releasedTexture, fence);
+  FrameSet frameSet;
+  const GLuint texture = d->renderThread->takeImage(&fence, &frameSet);
+  if (texture == 0)
+    return;
+  d->presenter.setImage(texture, fence);
+  update();
+  if (!frameSet.isNull())
+    emit frameRendered(frameSet);
 }
 
 
@@ -312,8 +209,7 @@ void ThreeDWidget::paintGL(void)
     qDebug() << "hasOpenGLFeature(QOpenGLFunctions::Multitexture) ==" << hasOpenGLFeature(QOpenGLFunctions::Multitexture);
     qDebug() << "hasOpenGLFeature(QOpenGLFunctions::Shaders) ==" << hasOpenGLFeature(QOpenGLFunctions::Shaders);
     qDebug() << "hasOpenGLFeature(QOpenGLFunctions::Framebuffers) ==" << hasOpenGLFeature(QOpenGLFunctions::Framebuffers);
-    qDebug() << "QGLFramebufferObject::hasOpenGLFramebufferBlit() ==" << QGLFramebufferObject::hasOpenGLFramebufferBlit();
-    qDebug() << "doubleBuffer() ==" << doubleBuffer();
+    qDebug() << "QOpenGLFramebufferObject::hasOpenGLFramebufferBlit() ==" << QOpenGLFramebufferObject::hasOpenGLFramebufferBlit();
     GLint h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
     glActiveTexture(GL_TEXTURE0);
     glGetIntegerv(GL_ACTIVE_TEXTURE, &h0);
@@ -327,82 +223,73 @@ void ThreeDWidget::paintGL(void)
     glGetIntegerv(GL_ACTIVE_TEXTURE, &h4);
     emit ready();
   }
-  else if (d->lastFrameFBO != nullptr && d->imageFBO != nullptr && d->shaderProgram != nullptr && d->timestamp > 0) {
-    drawIntoFBO();
-    drawOntoScreen();
+  else if (d->presenter.isInitialized() && d->presenter.hasImage()) {
+    d->presenter.draw(d->mvMatrix, width(), height());
+    if (d->timingOverlayVisible)
+      drawTimingOverlay();
   }
 }
 
 
-void ThreeDWidget::drawOntoScreen(void)
+void ThreeDWidget::drawTimingOverlay(void)
 {
   Q_D(ThreeDWidget);
-  d->shaderProgram->setAttributeArray(PROGRAM_VERTEX_ATTRIBUTE, Vertices);
-  d->shaderProgram->setUniformValue(d->mvMatrixLocation, d->mvMatrix);
-  glClearColor(.15f, .15f, .15f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glViewport(0, 0, width(), height());
-  // glViewport(d->viewport.x(), d->viewport.y(), d->viewport.width(), d->viewport.height());
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  QStringList lines;
+  lines << QString("%1 %2 %3").arg("GPU ms", -15).arg("p50", 6).arg("p99", 6);
+  QVector<GpuTimer::Timing> timings = d->presenter.timings();
+  if (d->renderThread != nullptr)
+    timings = d->renderThread->timings() + timings;
+  foreach (const GpuTimer::Timing &timing, timings) {
+    if (timing.samples > 0)
+      lines << QString("%1 %2 %3").arg(timing.stage, -15).arg(timing.p50, 6, 'f', 2).arg(timing.p99, 6, 'f', 2);
+  }
+  if (lines.count() == 1)
+    lines << "not available";
+  QPainter p(this);
+  static const QFont overlayFont("monospace", 8);
+  p.setFont(overlayFont);
+  const int lineHeight = p.fontMetrics().height();
+  const int w = p.fontMetrics().width(lines.first()) + 8;
+  p.fillRect(QRect(4, 4, w, lineHeight * lines.count() + 4), QColor(0, 0, 0, 160));
+  p.setPen(Qt::white);
+  for (int i = 0; i < lines.count(); ++i)
+    p.drawText(8, 4 + lineHeight * (i + 1) - p.fontMetrics().descent(), lines.at(i));
 }
 
 
-void ThreeDWidget::drawIntoFBO(void)
+void ThreeDWidget::setTimingOverlayVisible(bool visible)
 {
   Q_D(ThreeDWidget);
-  d->imageFBO->bind();
-  d->shaderProgram->setAttributeArray(PROGRAM_VERTEX_ATTRIBUTE, Vertices4FBO);
-  d->shaderProgram->setUniformValue(d->mvMatrixLocation, QMatrix4x4());
-  glViewport(0, 0, d->imageFBO->width(), d->imageFBO->height());
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  glActiveTexture(GL_TEXTURE3);
-  glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, d->imageFBO->width(), d->imageFBO->height(), 0);
-  d->imageFBO->release();
-
+  d->timingOverlayVisible = visible;
+  update();
 }
 
 
-void ThreeDWidget::process(INT64 nTime, const uchar *pRGB, const UINT16 *pDepth, int nMinReliableDist, int nMaxDist)
+void ThreeDWidget::setForwardMapping(bool enabled)
 {
   Q_D(ThreeDWidget);
-  Q_UNUSED(nMinReliableDist);
-  Q_UNUSED(nMaxDist);
-
-  Q_ASSERT_X(pDepth != nullptr && pRGB != nullptr, "ThreeDWidget::process()", "RGB or depth pointer must not be null");
-
-  d->timestamp = nTime;
-
-  HRESULT hr = d->coordinateMapper->MapColorFrameToDepthSpace(DepthSize, pDepth, ColorSize, d->mapping);
-  if (FAILED(hr))
-    qWarning() << "MapColorFrameToDepthSpace() failed.";
-  DSP *dst = d->intMapping;
-  const DepthSpacePoint *src = d->mapping;
-  const DepthSpacePoint *const srcEnd = d->mapping + ColorSize;
-  while (src < srcEnd)
-    *dst++ = src++;
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, d->videoTextureHandle);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ColorWidth, ColorHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, pRGB);
-  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "ThreeDWidget::process()", "glTexImage2D() failed");
-
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, d->depthTextureHandle);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, DepthWidth, DepthHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, pDepth);
-  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "ThreeDWidget::process()", "glTexImage2D() failed");
+  d->forwardMapping = enabled;
+}
 
-  glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_2D, d->mapTextureHandle);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, ColorWidth, ColorHeight, 0, GL_RG_INTEGER, GL_UNSIGNED_SHORT, d->intMapping);
-  Q_ASSERT_X(glGetError() == GL_NO_ERROR, "ThreeDWidget::process()", "glTexImage2D() failed");
 
-  glActiveTexture(GL_TEXTURE3);
-  glBindTexture(GL_TEXTURE_2D, d->lastFrameFBO->texture());
+void ThreeDWidget::setCalibration(const SensorCalibration &calibration)
+{
+  Q_D(ThreeDWidget);
+  d->calibration = calibration;
+  d->hasCalibration = true;
+  if (d->renderThread != nullptr)
+    d->renderThread->setCalibration(calibration);
+}
 
-  if (++d->frameCount > 1)
-    d->shaderProgram->setUniformValue(d->ignoreDepthLocation, false);
 
-  updateGL();
+void ThreeDWidget::showEvent(QShowEvent *e)
+{
+  QOpenGLWidget::showEvent(e);
+  // no new image is announced while one is waiting. It's taken right
+  // away, so the first paint doesn't show the one from before it was
+  // hidden; the window state may not have been updated yet when it's
+  // restored, so it isn't asked.
+  exchangeImage();
 }
 
 
@@ -436,7 +323,7 @@ void ThreeDWidget::mouseMoveEvent(QMouseEvent *e)
   }
   if (changed) {
     makeWorldMatrix();
-    updateGL();
+    update();
   }
   d->lastMousePos = e->pos();
 }
@@ -448,7 +335,7 @@ void ThreeDWidget::wheelEvent(QWheelEvent *e)
   d->zTrans += (e->delta() < 0 ? -1 : 1 ) * ((e->modifiers() & Qt::ShiftModifier)? .04f : .2f);
   updateViewport();
   makeWorldMatrix();
-  updateGL();
+  update();
 }
 
 
@@ -475,11 +362,11 @@ void ThreeDWidget::updateViewport(void)
 void ThreeDWidget::updateViewport(int w, int h)
 {
   Q_D(ThreeDWidget);
-  const QSizeF &glSize = d->scale * QSizeF(d->imageFBO->size());
+  const QSizeF &glSize = d->scale * QSizeF(ColorWidth, ColorHeight);
   const QPoint &topLeft = QPoint(w - int(glSize.width()), h - int(glSize.height())) / 2;
   d->viewport = QRect(topLeft + d->offset, glSize.toSize());
   d->resolution = d->viewport.size();
-  updateGL();
+  update();
 }
 
 
@@ -489,71 +376,78 @@ void ThreeDWidget::updateViewport(const QSize &sz)
 }
 
 
+// A slider that is dragged, or the six initial settings, would have
+// the last frame set rendered again for every single change. They're
+// collected for a display refresh instead and published at once.
+void ThreeDWidget::parametersChanged(void)
+{
+  Q_D(ThreeDWidget);
+  if (!d->parameterTimer.isActive())
+    d->parameterTimer.start();
+}
+
+
+void ThreeDWidget::publishParameters(void)
+{
+  Q_D(ThreeDWidget);
+  if (d->renderThread != nullptr)
+    d->renderThread->setParameters(d->parameters);
+}
+
+
 void ThreeDWidget::setContrast(GLfloat contrast)
 {
   Q_D(ThreeDWidget);
-  makeCurrent();
-  d->shaderProgram->setUniformValue(d->contrastLocation, contrast);
-  updateGL();
+  d->parameters.contrast = contrast;
+  parametersChanged();
 }
 
 
 void ThreeDWidget::setSaturation(GLfloat saturation)
 {
   Q_D(ThreeDWidget);
-  makeCurrent();
-  d->shaderProgram->setUniformValue(d->saturationLocation, saturation);
-  updateGL();
+  d->parameters.saturation = saturation;
+  parametersChanged();
 }
 
 
 void ThreeDWidget::setGamma(GLfloat gamma)
 {
   Q_D(ThreeDWidget);
-  makeCurrent();
-  d->shaderProgram->setUniformValue(d->gammaLocation, gamma);
-  updateGL();
+  d->parameters.gamma = gamma;
+  parametersChanged();
 }
 
 
 void ThreeDWidget::setNearThreshold(GLfloat nearThreshold)
 {
   Q_D(ThreeDWidget);
-  makeCurrent();
-  qDebug() << "ThreeDWidget::setNearThreshold(" << nearThreshold << ")";
-  d->shaderProgram->setUniformValue(d->nearThresholdLocation, nearThreshold);
-  updateGL();
+  d->parameters.nearThreshold = nearThreshold;
+  parametersChanged();
 }
 
 
 void ThreeDWidget::setFarThreshold(GLfloat farThreshold)
 {
   Q_D(ThreeDWidget);
-  makeCurrent();
-  qDebug() << "ThreeDWidget::setFarThreshold(" << farThreshold << ")";
-  d->shaderProgram->setUniformValue(d->farThresholdLocation, farThreshold);
-  updateGL();
+  d->parameters.farThreshold = farThreshold;
+  parametersChanged();
 }
 
 
 void ThreeDWidget::setHaloSize(int s)
 {
   Q_D(ThreeDWidget);
-  d->haloSize = 0;
-  const int xd = s;
-  const int yd = s / 2;
-  const int S = (xd + yd) / 2;
-  const int x0 = -xd;
-  const int x1 = +xd;
-  const int y0 = -yd;
-  const int y1 = +yd;
-  for (int y = y0; y < y1; ++y)
-    for (int x = x0; x < x1; ++x)
-      if (qAbs(x) + qAbs(y) <= S)
-        d->halo[d->haloSize++] = QVector2D(float(x) / DepthWidth, float(y) / DepthHeight);
-  d->shaderProgram->setUniformValueArray(d->haloLocation, d->halo, d->haloSize);
-  d->shaderProgram->setUniformValue(d->haloSizeLocation, d->haloSize);
-  updateGL();
+  d->parameters.haloSize = s;
+  parametersChanged();
+}
+
+
+void ThreeDWidget::setProcessingScale(int divisor)
+{
+  Q_D(ThreeDWidget);
+  d->parameters.processingScale = divisor;
+  parametersChanged();
 }
 
 
@@ -569,5 +463,5 @@ void ThreeDWidget::setRefPoints(const QVector<QVector3D>& refPoints)
   d->yRot = 0.f;
   d->zRot = 0.f;
   makeWorldMatrix();
-  updateGL();
+  update();
 }
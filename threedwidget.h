@@ -21,20 +21,27 @@
 #define __THREEDWIDGET_H_
 
 #include <QScopedPointer>
-#include <QGLWidget>
-#include <QOpenGLFunctions>
+#include <QOpenGLWidget>
+#include <QOpenGLExtraFunctions>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <QShowEvent>
 #include <QVector>
 #include <QVector3D>
 
-#include <Kinect.h>
+#include "kinectcompat.h"
 
 #include "globals.h"
+#include "frameset.h"
+#include "sensorcalibration.h"
 
 class ThreeDWidgetPrivate;
+class CaptureThread;
 
-class ThreeDWidget : public QGLWidget, protected QOpenGLFunctions
+// Shows the images of the removal placed in the world. The removal
+// itself runs on a RenderThread, which takes the frame sets from the
+// capture thread; the widget only draws what it has rendered.
+class ThreeDWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
   Q_OBJECT
 
@@ -45,7 +52,15 @@ public:
   virtual QSize minimumSizeHint(void) const { return QSize(ColorWidth / 2, ColorHeight / 2); }
   virtual QSize sizeHint(void) const { return QSize(ColorWidth, ColorHeight); }
 
-  void process(INT64 nTime, const uchar *pRGB, const UINT16 *pDepth, int minReliableDist, int maxDist);
+  // starts rendering the frame sets of the capture thread; the widget
+  // must have been shown, see ready()
+  void start(CaptureThread*);
+  void stop(void);
+
+  // projects the depth pixels into the color frame on the GPU instead
+  // of using the mapping that comes with the frame sets; must be
+  // called before start()
+  void setForwardMapping(bool enabled);
 
   void setContrast(GLfloat);
   void setSaturation(GLfloat);
@@ -56,10 +71,17 @@ public:
 
 public slots:
   void setHaloSize(int);
+  // see FrameRenderer::setProcessingScale()
+  void setProcessingScale(int divisor);
   void setRefPoints(const QVector<QVector3D> &);
+  void setCalibration(const SensorCalibration&);
+  // shows the GPU time of each rendering stage on top of the image
+  void setTimingOverlayVisible(bool);
 
 signals:
   void ready(void);
+  // a new image is shown, rendered from the given frame set
+  void frameRendered(const FrameSet&);
 
 protected:
   void initializeGL(void);
@@ -69,21 +91,25 @@ protected:
   void mouseReleaseEvent(QMouseEvent*);
   void mouseMoveEvent(QMouseEvent*);
   void wheelEvent(QWheelEvent*);
+  void showEvent(QShowEvent*);
+
+private slots:
+  void takeImage(void);
+  void publishParameters(void);
 
 private:
   QScopedPointer<ThreeDWidgetPrivate> d_ptr;
   Q_DECLARE_PRIVATE(ThreeDWidget)
   Q_DISABLE_COPY(ThreeDWidget)
 
-  void makeShader(void);
   void makeWorldMatrix(void);
+  void exchangeImage(void);
+  void drawTimingOverlay(void);
+  void parametersChanged(void);
 
   void updateViewport(void);
   void updateViewport(int w, int h);
   void updateViewport(const QSize &);
-
-  void drawOntoScreen(void);
-  void drawIntoFBO(void);
 };
 
 
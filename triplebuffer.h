@@ -0,0 +1,72 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TRIPLEBUFFER_H_
+#define __TRIPLEBUFFER_H_
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+// Hands the latest of a series of values from exactly one producer to
+// exactly one consumer thread without locks. The producer fills back()
+// and publishes it, the consumer takes the latest published value over
+// into front() with update(). front() isn't touched by the producer, so
+// the consumer may read it as long as it likes; values published in
+// between are overwritten, not queued.
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer(void)
+    : mBack(0)
+    , mMiddle(1)
+    , mFront(2)
+  { /* ... */ }
+
+  // producer side: back() doesn't hold the last published value, it
+  // has to be filled completely each time
+  T &back(void) { return mSlots[mBack]; }
+  void publish(void)
+  {
+    mBack = mMiddle.fetchAndStoreAcqRel(mBack | Fresh) & IndexMask;
+  }
+
+  // consumer side: returns false if nothing was published since the last call
+  bool update(void)
+  {
+    if ((mMiddle.loadAcquire() & Fresh) == 0)
+      return false;
+    mFront = mMiddle.fetchAndStoreAcqRel(mFront) & IndexMask;
+    return true;
+  }
+  const T &front(void) const { return mSlots[mFront]; }
+
+private:
+  enum { IndexMask = 3, Fresh = 4 };
+  T mSlots[3];
+  // the slot each side owns, and the one in between with a flag
+  // telling whether it was published after the consumer last looked
+  alignas(64) int mBack;
+  alignas(64) QAtomicInt mMiddle;
+  alignas(64) int mFront;
+
+  Q_DISABLE_COPY(TripleBuffer)
+};
+
+#endif // __TRIPLEBUFFER_H_
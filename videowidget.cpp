@@ -18,18 +18,20 @@
 */
 
 #include "globals.h"
+#include "colorconversion.h"
 #include "videowidget.h"
 
 #include <QDebug>
 #include <QImage>
 #include <QPainter>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
 class VideoWidgetPrivate
 {
 public:
   VideoWidgetPrivate(void)
-    : videoFrame(ColorWidth, ColorHeight, QImage::Format_ARGB32)
-    , windowAspectRatio(1.0)
+    : windowAspectRatio(1.0)
     , imageAspectRatio(qreal(ColorWidth) / qreal(ColorHeight))
   {
     // ...
@@ -39,7 +41,15 @@ public:
     // ...
   }
 
+  // BGRA frames are shown right from the pooled frame, YUY2 frames
+  // are converted into convertedFrame by a worker and then swapped
+  // with shownFrame
+  ColorFrameRef colorFrame;
+  ColorFrameRef pendingFrame;
+  QImage convertedFrame;
+  QImage shownFrame;
   QImage videoFrame;
+  QFutureWatcher<void> conversion;
   qreal windowAspectRatio;
   qreal imageAspectRatio;
 };
@@ -52,25 +62,63 @@ VideoWidget::VideoWidget(QWidget *parent)
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
   setMaximumSize(ColorWidth / 2, ColorHeight / 2);
   setMinimumSize(ColorWidth / 8, ColorHeight / 8);
+  QObject::connect(&d_ptr->conversion, SIGNAL(finished()), SLOT(conversionFinished()));
 }
 
 
 VideoWidget::~VideoWidget()
 {
-  // ...
+  Q_D(VideoWidget);
+  d->conversion.waitForFinished();
 }
 
 
-void VideoWidget::setVideoData(INT64 nTime, const QRgb *pBuffer, int nWidth, int nHeight)
+void VideoWidget::setColorFrame(const ColorFrameRef &frame)
 {
   Q_D(VideoWidget);
-  Q_UNUSED(nTime);
 
-  if (nWidth != ColorWidth || nHeight != ColorHeight || pBuffer == nullptr)
+  if (frame.isNull() || frame->width != ColorWidth || frame->height != ColorHeight)
+    return;
+
+  if (frame->format == ColorFormatYuy2) {
+    d->pendingFrame = frame;
+    if (!d->conversion.isRunning())
+      startConversion();
     return;
+  }
+  d->pendingFrame.reset();
+  // drop the image referring to the previous frame before letting go of it
+  d->videoFrame = QImage();
+  d->colorFrame = frame;
+  d->videoFrame = QImage(reinterpret_cast<const uchar*>(frame->buffer), ColorWidth, ColorHeight, QImage::Format_ARGB32);
+  update();
+}
+
 
-  memcpy_s(d->videoFrame.bits(), ColorSize * sizeof(QRgb), pBuffer, ColorSize * sizeof(QRgb));
+void VideoWidget::startConversion(void)
+{
+  Q_D(VideoWidget);
+  const ColorFrameRef frame = d->pendingFrame;
+  d->pendingFrame.reset();
+  if (d->convertedFrame.isNull())
+    d->convertedFrame = QImage(ColorWidth, ColorHeight, QImage::Format_ARGB32);
+  // nothing else refers to convertedFrame, so bits() doesn't detach
+  QRgb *dst = reinterpret_cast<QRgb*>(d->convertedFrame.bits());
+  d->conversion.setFuture(QtConcurrent::run([frame, dst]() {
+    yuy2ToBgra(reinterpret_cast<const uchar*>(frame->buffer), dst, ColorSize);
+  }));
+}
+
+
+void VideoWidget::conversionFinished(void)
+{
+  Q_D(VideoWidget);
+  qSwap(d->convertedFrame, d->shownFrame);
+  d->colorFrame.reset();
+  d->videoFrame = d->shownFrame;
   update();
+  if (!d->pendingFrame.isNull())
+    startConversion();
 }
 
 
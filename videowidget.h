@@ -20,7 +20,8 @@
 #ifndef __VIDEOWIDGET_H_
 #define __VIDEOWIDGET_H_
 
-#include <Kinect.h>
+#include "kinectcompat.h"
+#include "frameset.h"
 
 #include <QWidget>
 #include <QPaintEvent>
@@ -36,7 +37,9 @@ class VideoWidget : public QWidget
 public:
   explicit VideoWidget(QWidget *parent = nullptr);
   ~VideoWidget();
-  void setVideoData(INT64 nTime, const QRgb *pBuffer, int nWidth, int nHeight);
+  // YUY2 frames are converted on a worker thread; while a conversion is
+  // running, only the latest of the frames set meanwhile is kept
+  void setColorFrame(const ColorFrameRef&);
 
 protected:
   void resizeEvent(QResizeEvent*);
@@ -46,7 +49,12 @@ signals:
 
 public slots:
 
+private slots:
+  void conversionFinished(void);
+
 private:
+  void startConversion(void);
+
   QScopedPointer<VideoWidgetPrivate> d_ptr;
   Q_DECLARE_PRIVATE(VideoWidget)
   Q_DISABLE_COPY(VideoWidget)
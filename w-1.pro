@@ -1,4 +1,4 @@
-QT       += core gui widgets opengl
+QT       += core gui widgets concurrent
 
 TARGET = w-1
 TEMPLATE = app
@@ -13,6 +13,8 @@ win32 {
   else {
     LIBS += $$(KINECTSDK20_DIR)\lib\x64\kinect20.lib
   }
+  SOURCES += kinectframesource.cpp
+  HEADERS += kinectframesource.h
 }
 
 SOURCES += main.cpp \
@@ -21,7 +23,26 @@ SOURCES += main.cpp \
     videowidget.cpp \
     rgbdwidget.cpp \
     threedwidget.cpp \
-    irwidget.cpp
+    irwidget.cpp \
+    framesource.cpp \
+    replayframesource.cpp \
+    capturethread.cpp \
+    sessionwriter.cpp \
+    sessionreader.cpp \
+    colorconversion.cpp \
+    framesynchronizer.cpp \
+    sessionrecorder.cpp \
+    colormapper.cpp \
+    sensorcalibration.cpp \
+    coordinatemapper.cpp \
+    mappingcheck.cpp \
+    mappingconversion.cpp \
+    framerenderer.cpp \
+    headlessprocessor.cpp \
+    cpurenderer.cpp \
+    gputimer.cpp \
+    renderthread.cpp \
+    imagepresenter.cpp
 
 HEADERS  += mainwindow.h \
     util.h \
@@ -30,7 +51,34 @@ HEADERS  += mainwindow.h \
     rgbdwidget.h \
     threedwidget.h \
     globals.h \
-    irwidget.h
+    irwidget.h \
+    kinectcompat.h \
+    framesource.h \
+    replayframesource.h \
+    frameset.h \
+    spscring.h \
+    capturethread.h \
+    sessionformat.h \
+    sessionwriter.h \
+    sessionreader.h \
+    colorconversion.h \
+    simd.h \
+    framesynchronizer.h \
+    framepool.h \
+    sessionrecorder.h \
+    colormapper.h \
+    sensorcalibration.h \
+    coordinatemapper.h \
+    mappingcheck.h \
+    mappingconversion.h \
+    framerenderer.h \
+    headlessprocessor.h \
+    removalengine.h \
+    cpurenderer.h \
+    gputimer.h \
+    triplebuffer.h \
+    renderthread.h \
+    imagepresenter.h
 
 FORMS    += mainwindow.ui
 
@@ -38,6 +86,11 @@ DISTFILES += \
     .gitignore \
     shaders/mix.fs.glsl \
     shaders/mix.vs.glsl \
+    shaders/splat.vs.glsl \
+    shaders/splat.fs.glsl \
+    shaders/dilate.fs.glsl \
+    shaders/depthrange.fs.glsl \
+    shaders/present.fs.glsl \
     README.md
 
 RESOURCES += \